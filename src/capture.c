@@ -0,0 +1,292 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Raw capture of received data to file
+ *
+ * Received bytes are copied untransformed into a ring buffer which a
+ * writer thread drains into the capture file in large chunks written at
+ * chunk aligned offsets. File space is preallocated ahead of the data so
+ * the file system can keep the file contiguous. While idle, a partial
+ * chunk is written so data reaches the file, and written again once the
+ * chunk is complete.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/param.h>
+#include "capture.h"
+#include "ring.h"
+#include "print.h"
+
+#define CAPTURE_CHUNK (64 * 1024)
+#define CAPTURE_RING_SIZE (4 * 1024 * 1024)
+#define CAPTURE_PREALLOC (16 * 1024 * 1024)
+#define CAPTURE_IDLE_TIMEOUT 200 // ms
+
+static struct ring_t ring;
+static pthread_t thread;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static bool active = false;
+static bool stopping = false;
+static bool failed = false;
+static int capture_fd = -1;
+static char *capture_filename = NULL;
+static off_t file_offset = 0;
+static off_t allocated = 0;
+static bool prealloc_supported = true;
+static size_t unsignalled = 0;
+static size_t captured = 0;
+static size_t lost = 0;
+
+/* Write data at current chunk offset, runs in writer thread */
+static void capture_pwrite(const char *buffer, size_t count)
+{
+    ssize_t status;
+    size_t written = 0;
+
+#ifdef HAVE_FALLOCATE
+    /* Preallocate space ahead of data without changing file size */
+    if (prealloc_supported && ((file_offset + (off_t) count) > allocated))
+    {
+        if (fallocate(capture_fd, FALLOC_FL_KEEP_SIZE, allocated, CAPTURE_PREALLOC) == 0)
+        {
+            allocated += CAPTURE_PREALLOC;
+        }
+        else
+        {
+            // Not supported by file system, do not try again
+            prealloc_supported = false;
+        }
+    }
+#endif
+
+    while (written < count)
+    {
+        status = pwrite(capture_fd, buffer + written, count - written, file_offset + written);
+        if (status < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            tio_warning_printf("Could not write capture file (%s)", strerror(errno));
+            failed = true;
+            return;
+        }
+        written += status;
+    }
+}
+
+static void *capture_thread(void *arg)
+{
+    struct timespec deadline;
+    size_t available, partial = 0;
+    char *pointer;
+    bool stop;
+
+    (void) arg;
+
+    while (true)
+    {
+        pthread_mutex_lock(&mutex);
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += CAPTURE_IDLE_TIMEOUT * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (!stopping && (ring_read_space(&ring, &pointer) < CAPTURE_CHUNK))
+        {
+            if (pthread_cond_timedwait(&cond, &mutex, &deadline) == ETIMEDOUT)
+            {
+                break;
+            }
+        }
+        stop = stopping;
+        pthread_mutex_unlock(&mutex);
+
+        /* Write whole chunks, the ring size is a multiple of the chunk size
+         * so a chunk never wraps */
+        while ((available = ring_read_space(&ring, &pointer)) >= CAPTURE_CHUNK)
+        {
+            if (!failed)
+            {
+                capture_pwrite(pointer, CAPTURE_CHUNK);
+            }
+            ring_release(&ring, CAPTURE_CHUNK);
+            file_offset += CAPTURE_CHUNK;
+            partial = 0;
+        }
+
+        /* Write partial chunk if it grew, keep it in ring until complete */
+        if ((available > partial) && !failed)
+        {
+            capture_pwrite(pointer, available);
+            partial = available;
+        }
+
+        if (stop)
+        {
+            file_offset += available;
+            ring_release(&ring, available);
+#ifdef HAVE_FALLOCATE
+            /* Release space preallocated beyond end of data */
+            if (allocated > file_offset)
+            {
+                ftruncate(capture_fd, file_offset);
+            }
+#endif
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+int capture_start(const char *filename)
+{
+    if (active)
+    {
+        tio_warning_printf("Capture already in progress");
+        return -1;
+    }
+
+    capture_fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (capture_fd < 0)
+    {
+        tio_warning_printf("Could not open capture file %s (%s)", filename, strerror(errno));
+        return -1;
+    }
+
+    if ((ring.buffer == NULL) && (ring_init(&ring, CAPTURE_RING_SIZE) < 0))
+    {
+        tio_warning_printf("Could not allocate capture buffer");
+        close(capture_fd);
+        return -1;
+    }
+
+    ring.head = ring.tail = 0;
+    file_offset = allocated = 0;
+    prealloc_supported = true;
+    unsignalled = captured = lost = 0;
+    stopping = failed = false;
+
+    if (pthread_create(&thread, NULL, capture_thread, NULL) != 0)
+    {
+        tio_warning_printf("Could not start capture writer");
+        close(capture_fd);
+        return -1;
+    }
+
+    free(capture_filename);
+    capture_filename = strdup(filename);
+    active = true;
+
+    tio_printf("Capturing received data to %s", filename);
+
+    return 0;
+}
+
+void capture_stop(void)
+{
+    if (!active)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&mutex);
+    stopping = true;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread, NULL);
+
+    close(capture_fd);
+    capture_fd = -1;
+    active = false;
+
+    tio_printf("Captured %zu bytes to %s", captured, capture_filename);
+    if (lost > 0)
+    {
+        tio_warning_printf("Capture lost %zu bytes, writer could not keep up", lost);
+    }
+}
+
+bool capture_active(void)
+{
+    return active;
+}
+
+/* Copy received data to capture ring, runs in main thread */
+void capture_write(const char *buffer, size_t count)
+{
+    size_t space;
+    char *pointer;
+
+    if (!active)
+    {
+        return;
+    }
+
+    while (count > 0)
+    {
+        space = ring_write_space(&ring, &pointer);
+        if (space == 0)
+        {
+            lost += count;
+            break;
+        }
+        space = MIN(space, count);
+        memcpy(pointer, buffer, space);
+        ring_commit(&ring, space);
+        captured += space;
+        unsignalled += space;
+        buffer += space;
+        count -= space;
+    }
+
+    /* Wake up writer when a chunk is ready */
+    if (unsignalled >= CAPTURE_CHUNK)
+    {
+        unsignalled = 0;
+        pthread_mutex_lock(&mutex);
+        pthread_cond_signal(&cond);
+        pthread_mutex_unlock(&mutex);
+    }
+}
+
+void capture_print(void)
+{
+    if (active)
+    {
+        tio_printf(" Captured %zu bytes to %s", captured, capture_filename);
+    }
+}
@@ -58,6 +58,7 @@ struct config_t
     char *flow;
     char *parity;
     char *log_filename;
+    char *script_filename;
     char *socket;
     char *map;
 };
@@ -181,6 +182,34 @@ static int data_handler(void *user, const char *section, const char *name,
         {
             option.output_line_delay = read_integer(value, name, 0, LONG_MAX);
         }
+        else if (!strcmp(name, "flush-latency"))
+        {
+            option.flush_latency = read_integer(value, name, 0, LONG_MAX);
+        }
+        else if (!strcmp(name, "io-uring"))
+        {
+            option.io_uring = read_boolean(value, name);
+        }
+        else if (!strcmp(name, "rx-buffer-size"))
+        {
+            option.rx_buffer_size = read_integer(value, name, 0, LONG_MAX);
+        }
+        else if (!strcmp(name, "stats-interval"))
+        {
+            option.stats_interval = read_integer(value, name, 0, INT_MAX);
+        }
+        else if (!strcmp(name, "output-drain"))
+        {
+            option.output_drain = read_boolean(value, name);
+        }
+        else if (!strcmp(name, "output-buffer-size"))
+        {
+            option.output_buffer_size = read_integer(value, name, 1, LONG_MAX);
+        }
+        else if (!strcmp(name, "output-queue-depth"))
+        {
+            option.output_queue_depth = read_integer(value, name, 0, LONG_MAX);
+        }
         else if (!strcmp(name, "line-pulse-duration"))
         {
             line_pulse_duration_option_parse(value);
@@ -210,6 +239,10 @@ static int data_handler(void *user, const char *section, const char *name,
         {
             option.hex_mode = read_boolean(value, name);
         }
+        else if (!strcmp(name, "hexadecimal-format"))
+        {
+            option.hex_format = hex_format_option_parse(value);
+        }
         else if (!strcmp(name, "timestamp"))
         {
             option.timestamp = read_boolean(value, name) ?
@@ -281,6 +314,31 @@ static int data_handler(void *user, const char *section, const char *name,
         {
             option.alert = alert_option_parse(value);
         }
+        else if (!strcmp(name, "socket-max-clients"))
+        {
+            option.socket_max_clients = read_integer(value, name, 1, INT_MAX);
+        }
+        else if (!strcmp(name, "socket-queue-size"))
+        {
+            option.socket_queue_size = read_integer(value, name, 1, LONG_MAX);
+        }
+        else if (!strcmp(name, "socket-slow-client"))
+        {
+            option.socket_slow_client = socket_slow_client_option_parse(value);
+        }
+        else if (!strcmp(name, "socket-shm-size"))
+        {
+            option.socket_shm_size = read_integer(value, name, 0, LONG_MAX);
+        }
+        else if (!strcmp(name, "script"))
+        {
+            asprintf(&c.script_filename, "%s", value);
+            option.script_filename = c.script_filename;
+        }
+        else if (!strcmp(name, "transfer-protocol"))
+        {
+            option.transfer_protocol = xymodem_option_parse(value);
+        }
         else if (!strcmp(name, "mute"))
         {
             option.mute = read_boolean(value, name);
@@ -473,6 +531,7 @@ void config_exit(void)
     free(c.flow);
     free(c.parity);
     free(c.log_filename);
+    free(c.script_filename);
     free(c.map);
 
     free(c.match);
@@ -0,0 +1,374 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Hardware flow control (CTS) watcher
+ *
+ * A helper thread blocks in TIOCMIWAIT and wakes up the main loop via a pipe
+ * whenever CTS changes, so output is held back while the device is not
+ * ready without reading the modem lines for every write.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include "cts.h"
+#include "event.h"
+#include "print.h"
+
+#ifdef HAVE_TIOCMIWAIT
+
+/* A change of CTS happening just before the watcher enters TIOCMIWAIT goes
+ * unnoticed, so CTS is also read now and then while output is held */
+#define CTS_RECHECK_INTERVAL 100000     // us
+
+/* Real-time signal interrupting the watcher thread when it is to stop, its
+ * previous disposition is restored once the watcher has stopped */
+#define CTS_STOP_SIGNAL SIGRTMIN
+
+static pthread_t thread;
+static struct sigaction previous_action;
+static bool running = false;
+static int pipefd[2] = { -1, -1 };
+static int device_fd = -1;
+static int line_clear = 1;              // Written by watcher thread
+static bool stopping = false;           // Read by watcher thread
+static bool stopped = false;            // Written by watcher thread
+
+static bool clear = true;
+static bool holding = false;
+static unsigned long hold_count = 0;
+static int64_t hold_total = 0;          // us
+static struct timespec hold_start;
+static struct timespec recheck;
+
+static int64_t elapsed_us(const struct timespec *since)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - since->tv_sec) * 1000000LL + (now.tv_nsec - since->tv_nsec) / 1000;
+}
+
+static int read_line(int fd)
+{
+    int state;
+
+    if (ioctl(fd, TIOCMGET, &state) < 0)
+    {
+        return -1;
+    }
+
+    return (state & TIOCM_CTS) ? 1 : 0;
+}
+
+static void stop_signal_handler(int signum)
+{
+    (void) signum;
+}
+
+static void *cts_thread(void *arg)
+{
+    (void) arg;
+    char c = 0;
+    int status;
+
+    while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE))
+    {
+        /* Wait for CTS to change, interrupted by stop signal */
+        status = ioctl(device_fd, TIOCMIWAIT, TIOCM_CTS);
+
+        if ((status < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+
+        /* Stop holding output if line can no longer be watched */
+        status = (status < 0) ? -1 : read_line(device_fd);
+        __atomic_store_n(&line_clear, (status != 0), __ATOMIC_RELEASE);
+        write(pipefd[1], &c, 1);
+
+        if (status < 0)
+        {
+            break;
+        }
+    }
+
+    __atomic_store_n(&stopped, true, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+static void update(bool state)
+{
+    if (state == clear)
+    {
+        return;
+    }
+
+    clear = state;
+
+    if (clear && holding)
+    {
+        hold_total += elapsed_us(&hold_start);
+        holding = false;
+    }
+}
+
+/* Start watching CTS of device with hardware flow control */
+void cts_start(int fd)
+{
+    int status = read_line(fd);
+
+    clear = true;
+    holding = false;
+
+    if (status < 0)
+    {
+        tio_debug_printf("CTS not available (%s)", strerror(errno));
+        return;
+    }
+
+    if (pipefd[0] < 0)
+    {
+        if ((pipe(pipefd) == -1) ||
+            (fcntl(pipefd[0], F_SETFL, O_NONBLOCK) == -1) ||
+            (fcntl(pipefd[1], F_SETFL, O_NONBLOCK) == -1))
+        {
+            tio_error_printf("Failed to create pipe");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* No SA_RESTART so the signal makes TIOCMIWAIT return with EINTR */
+    struct sigaction action = {};
+    action.sa_handler = stop_signal_handler;
+    sigemptyset(&action.sa_mask);
+    sigaction(CTS_STOP_SIGNAL, &action, &previous_action);
+
+    device_fd = fd;
+    line_clear = status;
+    clear = status;
+    stopping = false;
+    stopped = false;
+
+    if (pthread_create(&thread, NULL, cts_thread, NULL) != 0)
+    {
+        tio_error_printf("pthread_create() error");
+        exit(EXIT_FAILURE);
+    }
+    running = true;
+
+    if (event_add(pipefd[0], EVENT_READ) < 0)
+    {
+        tio_error_printf("Could not register CTS pipe (%s)", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+void cts_stop(void)
+{
+    char buffer[64];
+
+    if (!running)
+    {
+        return;
+    }
+
+    /* The signal may arrive just before the watcher enters TIOCMIWAIT, so
+     * keep interrupting it until it has seen the stop request */
+    __atomic_store_n(&stopping, true, __ATOMIC_RELEASE);
+    while (!__atomic_load_n(&stopped, __ATOMIC_ACQUIRE))
+    {
+        pthread_kill(thread, CTS_STOP_SIGNAL);
+        poll(NULL, 0, 1);
+    }
+    pthread_join(thread, NULL);
+    running = false;
+
+    sigaction(CTS_STOP_SIGNAL, &previous_action, NULL);
+
+    event_remove(pipefd[0]);
+    while (read(pipefd[0], buffer, sizeof(buffer)) > 0);
+
+    update(true);
+}
+
+int cts_fd(void)
+{
+    return running ? pipefd[0] : -1;
+}
+
+/* Pick up CTS state reported by watcher thread */
+void cts_acknowledge(void)
+{
+    char buffer[64];
+
+    while (read(pipefd[0], buffer, sizeof(buffer)) > 0);
+
+    update(__atomic_load_n(&line_clear, __ATOMIC_ACQUIRE));
+}
+
+/* Returns true if output must be held back because CTS is low */
+bool cts_blocked(void)
+{
+    return running && !clear;
+}
+
+/* Output is being held back, count time until CTS goes high */
+void cts_hold(void)
+{
+    if (holding)
+    {
+        return;
+    }
+
+    holding = true;
+    hold_count++;
+    clock_gettime(CLOCK_MONOTONIC, &hold_start);
+    recheck = hold_start;
+}
+
+/* Return time in microseconds until CTS is due to be read again, or -1 if not holding output */
+long cts_timeout(void)
+{
+    int64_t remaining;
+
+    if (!holding)
+    {
+        return -1;
+    }
+
+    remaining = CTS_RECHECK_INTERVAL - elapsed_us(&recheck);
+
+    return (remaining > 0) ? remaining : 0;
+}
+
+/* Read CTS directly in case a change was missed by watcher thread */
+void cts_refresh(void)
+{
+    int status;
+
+    clock_gettime(CLOCK_MONOTONIC, &recheck);
+
+    if (!running)
+    {
+        return;
+    }
+
+    status = read_line(device_fd);
+    update(status != 0);
+}
+
+/* Block until CTS is high */
+void cts_wait(void)
+{
+    struct pollfd pfd = { .fd = pipefd[0], .events = POLLIN };
+
+    cts_hold();
+
+    while (cts_blocked())
+    {
+        if (poll(&pfd, 1, CTS_RECHECK_INTERVAL / 1000) > 0)
+        {
+            cts_acknowledge();
+        }
+        else
+        {
+            cts_refresh();
+        }
+    }
+}
+
+void cts_print(void)
+{
+    int64_t total;
+
+    if (!running && (hold_count == 0))
+    {
+        return;
+    }
+
+    total = hold_total + (holding ? elapsed_us(&hold_start) : 0);
+
+    tio_printf(" Output held %lu times by CTS for %lld.%03lld s%s", hold_count,
+               (long long) (total / 1000000), (long long) ((total / 1000) % 1000),
+               holding ? " (held now)" : "");
+}
+
+#else
+
+void cts_start(int fd)
+{
+    (void) fd;
+}
+
+void cts_stop(void)
+{
+}
+
+int cts_fd(void)
+{
+    return -1;
+}
+
+void cts_acknowledge(void)
+{
+}
+
+bool cts_blocked(void)
+{
+    return false;
+}
+
+void cts_hold(void)
+{
+}
+
+long cts_timeout(void)
+{
+    return -1;
+}
+
+void cts_refresh(void)
+{
+}
+
+void cts_wait(void)
+{
+}
+
+void cts_print(void)
+{
+}
+
+#endif
@@ -0,0 +1,217 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Event loop
+ *
+ * File descriptors are registered once and registrations are updated
+ * incrementally as sources come and go. Uses epoll where available and
+ * falls back to poll() elsewhere.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "event.h"
+
+#ifdef HAVE_EPOLL
+
+#include <sys/epoll.h>
+
+static int epfd = -1;
+
+int event_init(void)
+{
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+
+    return (epfd < 0) ? -1 : 0;
+}
+
+int event_add(int fd, unsigned int events)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = ((events & EVENT_READ) ? EPOLLIN : 0) | ((events & EVENT_WRITE) ? EPOLLOUT : 0);
+    ev.data.fd = fd;
+
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+int event_modify(int fd, unsigned int events)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = ((events & EVENT_READ) ? EPOLLIN : 0) | ((events & EVENT_WRITE) ? EPOLLOUT : 0);
+    ev.data.fd = fd;
+
+    return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+int event_remove(int fd)
+{
+    return epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+/* Wait up to timeout microseconds (-1 = forever) for registered events */
+int event_wait(struct event_t *events, int max_events, long timeout)
+{
+    struct epoll_event ev[max_events];
+    int count;
+
+    // Round up to whole milliseconds so we never wake up early
+    count = epoll_wait(epfd, ev, max_events, (timeout < 0) ? -1 : (int) ((timeout + 999) / 1000));
+
+    for (int i = 0; i < count; i++)
+    {
+        events[i].fd = ev[i].data.fd;
+        events[i].events = 0;
+
+        // Report errors and hangups as readable so they are detected by read()
+        if (ev[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        {
+            events[i].events |= EVENT_READ;
+        }
+        if (ev[i].events & EPOLLOUT)
+        {
+            events[i].events |= EVENT_WRITE;
+        }
+    }
+
+    return count;
+}
+
+#else
+
+#include <poll.h>
+
+static struct pollfd *pollfds = NULL;
+static int pollfds_count = 0;
+static int pollfds_size = 0;
+
+int event_init(void)
+{
+    return 0;
+}
+
+int event_add(int fd, unsigned int events)
+{
+    for (int i = 0; i < pollfds_count; i++)
+    {
+        if (pollfds[i].fd == fd)
+        {
+            errno = EEXIST;
+            return -1;
+        }
+    }
+
+    if (pollfds_count == pollfds_size)
+    {
+        int size = pollfds_size ? pollfds_size * 2 : 16;
+        struct pollfd *p = realloc(pollfds, size * sizeof(struct pollfd));
+        if (p == NULL)
+        {
+            return -1;
+        }
+        pollfds = p;
+        pollfds_size = size;
+    }
+
+    pollfds[pollfds_count].fd = fd;
+    pollfds[pollfds_count].events = ((events & EVENT_READ) ? POLLIN : 0) | ((events & EVENT_WRITE) ? POLLOUT : 0);
+    pollfds[pollfds_count].revents = 0;
+    pollfds_count++;
+
+    return 0;
+}
+
+int event_modify(int fd, unsigned int events)
+{
+    for (int i = 0; i < pollfds_count; i++)
+    {
+        if (pollfds[i].fd == fd)
+        {
+            pollfds[i].events = ((events & EVENT_READ) ? POLLIN : 0) | ((events & EVENT_WRITE) ? POLLOUT : 0);
+            return 0;
+        }
+    }
+
+    errno = ENOENT;
+    return -1;
+}
+
+int event_remove(int fd)
+{
+    for (int i = 0; i < pollfds_count; i++)
+    {
+        if (pollfds[i].fd == fd)
+        {
+            pollfds[i] = pollfds[--pollfds_count];
+            return 0;
+        }
+    }
+
+    errno = ENOENT;
+    return -1;
+}
+
+/* Wait up to timeout microseconds (-1 = forever) for registered events */
+int event_wait(struct event_t *events, int max_events, long timeout)
+{
+    int status, count = 0;
+
+    // Round up to whole milliseconds so we never wake up early
+    status = poll(pollfds, pollfds_count, (timeout < 0) ? -1 : (int) ((timeout + 999) / 1000));
+    if (status <= 0)
+    {
+        return status;
+    }
+
+    for (int i = 0; (i < pollfds_count) && (count < max_events); i++)
+    {
+        short revents = pollfds[i].revents;
+
+        if (revents == 0)
+        {
+            continue;
+        }
+
+        events[count].fd = pollfds[i].fd;
+        events[count].events = 0;
+
+        // Report errors and hangups as readable so they are detected by read()
+        if (revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL))
+        {
+            events[count].events |= EVENT_READ;
+        }
+        if (revents & POLLOUT)
+        {
+            events[count].events |= EVENT_WRITE;
+        }
+        count++;
+    }
+
+    return count;
+}
+
+#endif
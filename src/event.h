@@ -0,0 +1,37 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#pragma once
+
+#define EVENT_READ  0x1
+#define EVENT_WRITE 0x2
+
+struct event_t
+{
+    int fd;
+    unsigned int events;
+};
+
+int event_init(void);
+int event_add(int fd, unsigned int events);
+int event_modify(int fd, unsigned int events);
+int event_remove(int fd);
+int event_wait(struct event_t *events, int max_events, long timeout);
@@ -39,6 +39,7 @@
 #include "time.h"
 #include "extension.h"
 #include "options.h"
+#include "send.h"
 
 
 extern struct termios tio, tio_old, stdout_new, stdout_old, stdin_new, stdin_old;
@@ -451,268 +452,118 @@ void check_input_kb_event(char input_char, char*mount_string)
 
 
 
-#ifdef ENABLE_SEND_FILE
-/****************************************************************************************************/
-/****************************************************************************************************/
-/************ Starting with this point, there are my code to manage send file from tio. *************/
-/****************************************************************************************************/
-/****************************************************************************************************/
-
-#define X_ON  17
-#define X_OFF 19
-
-static char console_getc(void)
-{
-  int     status;
-  char    input_char;
-
-  status = 0;                                                 //force to enter the loop
-  while(status < 1)
-  {
-    /* Check input from stdin. It is inside a while because now it is a non blocking function */
-    status = read(STDIN_FILENO, &input_char, 1);
-    if (status < 0)
-    {
-      tio_error_printf_silent("Could not read from stdin");
-      tty_disconnect();
-      return TIO_ABORT;
-    }
-  }
-  return input_char;
-}
+/*
+ * Console file name entry, shared by file send and file transfers
+ */
 
+static char  fname[256];
+static char  *fname_end = fname;
+static bool  fname_entry = false;
+static void  (*fname_done)(const char *fname);
 
 /*
- * console_get_filename(char *s, int len)
+ * filename_input(char c)
  *
- * Wait for a string to be entered on the console, limited
- * support for editing characters (back space only)
- * end when a <CR> character is received. Functio aborted with an <Esc>
- * 
- * It returns the number of chars in buffer
+ * Handle a character of the file name entered on the console, limited
+ * support for editing characters (back space only). Entry ends when a
+ * <CR> character is received and is aborted with an <Esc>.
+ *
+ * Called from the main loop for every stdin character while
+ * filename_entry() is true.
  */
-static int console_get_filename(char *s, int len)
+void filename_input(char c)
 {
-  char  c;
   bool  valid_fname_char;
   const char inv_filename_ch[25] = {27,32,33,34,35,36,37,38,39,'(',')','*','[',']','{','}',';','^',60,'=',62,'@',0}; //<Esc> !“#=$%&‘()*[]{}|;^<=>@
-  char  *t = s;
 
-  printf("\r\nEnter file name to send: ");
-  fflush(stdout);
-  print = print_normal;
-  *t = '\000';
-  /* read until a <CR> is received */
-  while ((c = console_getc()) != '\r')
+  if (c == '\r')
   {
-    /* First check valid characters in filename */
-    valid_fname_char = true;
-    for (unsigned int i = 0; i < sizeof(inv_filename_ch); i++)
+    fname_entry = false;
+    if (fname_end == fname)
     {
-      if(c == inv_filename_ch[i])
-      valid_fname_char = false;
+      printf("\r\nOperation aborted by user!\r\n");
+      return;
     }
-    if (c == 0x7F)                                            //Backspace
-    {
-      if (t > s)
-      {
-        /* send ^H' '^H to erase previous character */
-        printf("\b \b");
-        t--;
-      }
-    }   //if (c == 0x7F)
-    else {
-      if (valid_fname_char)
-      {
-        *t = c;
-        print(c);
-        if ((t - s) < len)
-          t++;
-      }
-    }   //else if (c == 0x7F)
-    if (c == 0x1B)                                            //Esc
-    {
-      return 0;
-    }   //if (c == 0x1B)
-    /* update end of string with NUL */
-    *t = '\000';
-  }   //while (c = console_getc()) != '\r')
-  return t - s;
-}
-
-
-void file_send(void)
-{
-  fd_set  rdfs;                                               // Read file descriptor set
-  int     maxfd;                                              // Maximum file descriptor used
-  char    input_buffer[BUFSIZ];
-  struct  timeval tv;
-  int     status, state;
-  ssize_t rx_tty_received;
-  char    ch_stdin, ch_tty_in[64], ch_file_in, fname[256];
-  FILE    *fp;
-  long    fileSize, filecount;
-  bool    x_on_state;                                         //TX go flag
-  bool    hw_flow_ctrl = false;
-  bool    sw_flow_ctrl = false;
-
-
-  print = print_normal;
+    printf("\r\n");
+    fflush(stdout);
 
-  //First of all, identify type of Flow Control used
-  if(!((tio.c_cflag & CRTSCTS) || (tio.c_iflag & (IXON | IXOFF))))
-    //Flow Control is NONE
-    x_on_state = true;
-  else
-  {
-    //Flow Control is ON
-    if(tio.c_cflag & CRTSCTS)
-    {
-      //Flow Control is Hardware: Replicate CTS state to x_on_state
-      hw_flow_ctrl = true;
-    }
-    else
-    {
-      //Flow Control is SW: If received is X_OFF, lock TX, than wait for a X_ON to get a new clearance
-      if( (((tio.c_iflag & IXON) == IXON) || ((tio.c_iflag & IXOFF) == IXOFF)) )
-        sw_flow_ctrl = true;
-    }
+    fname_done(fname);
+    return;
   }
 
-  //Get from user the file name to transmit
-  status = console_get_filename(fname, 255);
-  if (status == 0)
+  if (c == 0x1B)                                              //Esc
   {
-    //Aborted
-    printf("\r\nSend file aborted by user!\r\n");
+    fname_entry = false;
+    printf("\r\nOperation aborted by user!\r\n");
     return;
+  }   //if (c == 0x1B)
+
+  /* First check valid characters in filename */
+  valid_fname_char = true;
+  for (unsigned int i = 0; i < sizeof(inv_filename_ch); i++)
+  {
+    if(c == inv_filename_ch[i])
+    valid_fname_char = false;
   }
-  printf("\r\n");
-  fflush(stdout);
- 
-  if ((fp=fopen (fname,"r")) != NULL)
+  if (c == 0x7F)                                              //Backspace
   {
-    /* Get file size */
-    fseek(fp, 0, SEEK_END);
-    fileSize = ftell(fp);
-    fseek(fp, 0, SEEK_SET);                                   //Positioning to read from the beginning of file
-    
-    if(fileSize)
+    if (fname_end > fname)
     {
-      filecount = 0;
-      //Get first char from file
-      ch_file_in = fgetc(fp);
-      x_on_state = true;                                      //Starts with "TX can go on"
-
-      while(filecount < fileSize)
-      {
-        // In file transfer mode, while we are reading file and sending to tty device, we need to
-        // read from stdin to react on <Esc> input key to abort, and tty input to send to stdout.
-        FD_ZERO(&rdfs);
-        FD_SET(fd, &rdfs);
-        FD_SET(STDIN_FILENO, &rdfs);
+      /* send ^H' '^H to erase previous character */
+      printf("\b \b");
+      fflush(stdout);
+      fname_end--;
+    }
+  }   //if (c == 0x7F)
+  else {
+    if (valid_fname_char)
+    {
+      *fname_end = c;
+      print_normal(c);
+      print_buffer_flush();
+      if ((fname_end - fname) < (int)(sizeof(fname) - 1))
+        fname_end++;
+    }
+  }   //else if (c == 0x7F)
+  /* update end of string with NUL */
+  *fname_end = '\000';
+}
 
-        maxfd = MAX(fd, STDIN_FILENO);
+bool filename_entry(void)
+{
+  return fname_entry;
+}
 
-        /* Manage timeout: No timeout */
-        tv.tv_sec = 0;
-        tv.tv_usec = 0;
+/* Prompt for a file name, done() is called when entry is completed */
+void filename_request(const char *prompt, void (*done)(const char *fname))
+{
+  print_buffer_flush();
+  printf("\r\n%s", prompt);
+  fflush(stdout);
+  fname_end = fname;
+  *fname_end = '\000';
+  fname_done = done;
+  fname_entry = true;
+}
 
-        status = select(maxfd + 1, &rdfs, NULL, NULL, &tv);
-        if (status > 0)
-        {
-          if (FD_ISSET(fd, &rdfs))
-          {
-            // Input from tty device ready
-            rx_tty_received = read(fd, input_buffer, BUFSIZ);
-            if (rx_tty_received < 0)
-            {
-              // Error reading - device is likely unplugged
-              tio_printf("Could not read from tty device");
-              tty_disconnect();
-              return;
-            }
-            if(rx_tty_received > 0)
-            {
-              // Update receive statistics
-              rx_total += rx_tty_received;
-              // Print received tty character to stdout
-              for (int i = 0; i < rx_tty_received; i++)
-                print(input_buffer[i]);
-            }
-          }   //if (FD_ISSET(fd, &rdfs))
-          if (FD_ISSET(STDIN_FILENO, &rdfs))
-          {
-            // Input from stdin ready
-            status = read(STDIN_FILENO, &ch_stdin, 1);
-            if(status < 0)
-            {
-              tio_error_printf("Could not read from stdin");
-              tty_disconnect();
-              return;
-            }
-            if( (status > 0) && (TIO_ABORT == ch_stdin) )
-            {
-              tio_warning_printf("\r\nSend file aborted by user!\r\n");
-              break;                                          //quit while(filecount < fileSize)
-            }
-          }   //else if (FD_ISSET(STDIN_FILENO, &rdfs))
-        }   //if (status > 0)
-
-        // Read transmission's clearance
-        //Flow Control is ON
-        if(hw_flow_ctrl)
-        {
-          //Flow Control is Hardware: Replicate CTS state to x_on_state
-          if(ioctl(fd, TIOCMGET, &state) < 0)
-          {
-            tio_printf("Could not get line state: %s", strerror(errno));
-            break;
-          }
-          else
-            x_on_state = (state & TIOCM_CTS);
-        } //if(hw_flow_ctrl)
-        else
-        {
-          //Flow Control is SW: If received is X_OFF, lock TX, than wait for a X_ON to get a new clearance
-          if(sw_flow_ctrl)
-          {
-            for (int i = 0; i < rx_tty_received; i++)
-            {
-              if(x_on_state && (ch_tty_in[i] == X_OFF))
-                x_on_state = false;
-              else if(!x_on_state && (ch_tty_in[i] == X_ON))
-                x_on_state = true;
-            } //for (int i = 0; i < rx_tty_received; i++)
-          } //if(sw_flow_ctrl)
-        } //else if(hw_flow_ctrl)
-
-        // Prepare data and send it, if cleared
-        if(x_on_state)
-        {
-          // Map newline character
-          if( (ch_file_in == '\n') && (map_o_nl_crnl) )
-            ch_file_in = '\r';
 
-          // Map output character
-          if( (ch_file_in == '\r') && (map_o_cr_nl) )
-            ch_file_in = '\n';
 
-          //No need to use epoll here, as it will block if not ready
-          forward_to_tty(fd, ch_file_in);
+#ifdef ENABLE_SEND_FILE
+/****************************************************************************************************/
+/****************************************************************************************************/
+/************ Starting with this point, there are my code to manage send file from tio. *************/
+/****************************************************************************************************/
+/****************************************************************************************************/
 
-          fsync(fd);                                      //update log file
-          ch_file_in = fgetc(fp);                         //Get next char from file to transmit
-          filecount++;
-          delay(option.output_delay);
-        } //if(x_on_state)
-      } //while(filecount < fileSize)
-    }   //if(fileSize)
+static void file_send_done(const char *fname)
+{
+  //File is streamed to tty device from the main loop
+  send_file_start(fname);
+}
 
-    fclose(fp);
-    tio_printf("File send concluded!\r\n");
-  } //if ((fp=fopen (fname,"r")) != NULL)
-  else
-    tio_printf("Operation aborted: file not found!\r\n");
+void file_send(void)
+{
+  //Get from user the file name to transmit
+  filename_request("Enter file name to send: ", file_send_done);
 } //file_send(void)
 #endif  //#ifdef ENABLE_SEND_FILE
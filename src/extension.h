@@ -30,5 +30,8 @@
 void check_input_kb_event(char input_char, char*mount_string);
 bool load_key_matrix(void);
 void file_send(void);
+void filename_input(char c);
+bool filename_entry(void);
+void filename_request(const char *prompt, void (*done)(const char *fname));
 
 #endif	//#ifndef UPGRADES_H
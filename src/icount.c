@@ -0,0 +1,162 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Kernel serial line error counters (TIOCGICOUNT)
+ *
+ * Counters are sampled at connect and reported relative to that, so they
+ * only reflect errors which happened during the tio session. While data is
+ * being received the counters are polled from the main loop at most every
+ * ICOUNT_POLL_INTERVAL, never per received chunk.
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <sys/ioctl.h>
+#include "icount.h"
+#include "print.h"
+
+#ifdef HAVE_TIOCGICOUNT
+
+#include <linux/serial.h>
+
+#define ICOUNT_POLL_INTERVAL 100000 // us
+
+static struct serial_icounter_struct icount_start;
+static struct serial_icounter_struct icount_last;
+static bool icount_supported = false;
+static bool icount_due = false;
+static struct timespec icount_time;
+
+void icount_reset(int fd)
+{
+    icount_supported = (ioctl(fd, TIOCGICOUNT, &icount_start) == 0);
+    icount_last = icount_start;
+    icount_due = false;
+    clock_gettime(CLOCK_MONOTONIC, &icount_time);
+}
+
+/* Note that data was received so counters are polled when next due */
+void icount_received(void)
+{
+    icount_due = icount_supported;
+}
+
+/* Return time in microseconds until counters are due to be polled, or -1 if nothing was received */
+long icount_timeout(void)
+{
+    struct timespec now;
+    int64_t remaining;
+
+    if (!icount_due)
+    {
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    remaining = ICOUNT_POLL_INTERVAL - ((now.tv_sec - icount_time.tv_sec) * 1000000LL +
+                                        (now.tv_nsec - icount_time.tv_nsec) / 1000);
+
+    return (remaining > 0) ? remaining : 0;
+}
+
+/* Sample counters, returns true if new overruns occurred since last poll */
+bool icount_poll(int fd)
+{
+    struct serial_icounter_struct icount;
+    bool overrun;
+
+    if (!icount_supported)
+    {
+        return false;
+    }
+
+    icount_due = false;
+    clock_gettime(CLOCK_MONOTONIC, &icount_time);
+
+    if (ioctl(fd, TIOCGICOUNT, &icount) != 0)
+    {
+        // Stop polling devices which do not support counters
+        if ((errno == ENOTTY) || (errno == EINVAL))
+        {
+            icount_supported = false;
+        }
+        return false;
+    }
+
+    overrun = (icount.overrun != icount_last.overrun) || (icount.buf_overrun != icount_last.buf_overrun);
+    if (overrun)
+    {
+        tio_warning_printf("Data lost: %d UART overrun(s), %d buffer overrun(s)",
+                           icount.overrun - icount_last.overrun,
+                           icount.buf_overrun - icount_last.buf_overrun);
+    }
+
+    icount_last = icount;
+
+    return overrun;
+}
+
+void icount_print(void)
+{
+    if (!icount_supported)
+    {
+        return;
+    }
+
+    tio_printf(" Overrun errors: %d UART, %d buffer", icount_last.overrun - icount_start.overrun,
+                                                      icount_last.buf_overrun - icount_start.buf_overrun);
+    tio_printf(" Frame errors: %d", icount_last.frame - icount_start.frame);
+    tio_printf(" Parity errors: %d", icount_last.parity - icount_start.parity);
+    tio_printf(" Breaks: %d", icount_last.brk - icount_start.brk);
+}
+
+#else
+
+void icount_reset(int fd)
+{
+    (void) fd;
+}
+
+void icount_received(void)
+{
+}
+
+long icount_timeout(void)
+{
+    return -1;
+}
+
+bool icount_poll(int fd)
+{
+    (void) fd;
+    return false;
+}
+
+void icount_print(void)
+{
+}
+
+#endif
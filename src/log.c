@@ -31,15 +31,21 @@
 #include <sys/time.h>
 #include <libgen.h>
 #include "options.h"
+#include "log.h"
 #include "print.h"
 #include "error.h"
+#include "uring.h"
 
 #define IS_ESC_CSI_INTERMEDIATE_CHAR(c) ((c >= 0x20) && (c <= 0x3F))
 #define IS_ESC_END_CHAR(c)              ((c >= 0x30) && (c <= 0x7E))
 #define IS_CTRL_CHAR(c)                 ((c >= 0x00) && (c <= 0x1F))
 
+#define LOG_BATCH_SIZE (BUFSIZ*4)
+
 static FILE *fp = NULL;
 static char file_buffer[BUFSIZ];
+static char batch_buffer[LOG_BATCH_SIZE];
+static size_t batch_count = 0;
 static const char *log_filename = NULL;
 
 static char *date_time(void)
@@ -56,6 +62,63 @@ static char *date_time(void)
     return date_time_string;
 }
 
+/* Write log output, collecting it for batched submission when io_uring is in use */
+static void log_output(const char *buffer, size_t count)
+{
+    if (!uring_enabled())
+    {
+        fwrite(buffer, 1, count, fp);
+        return;
+    }
+
+    if ((batch_count + count) > LOG_BATCH_SIZE)
+    {
+        log_flush();
+    }
+
+    if (count > LOG_BATCH_SIZE)
+    {
+        fwrite(buffer, 1, count, fp);
+        fflush(fp);
+        return;
+    }
+
+    memcpy(batch_buffer + batch_count, buffer, count);
+    batch_count += count;
+}
+
+/* Write out pending batched log output */
+void log_flush(void)
+{
+    if (fp == NULL)
+    {
+        return;
+    }
+
+    /* Writes still in flight via io_uring go first */
+    uring_wait(fileno(fp));
+
+    if (batch_count > 0)
+    {
+        fwrite(batch_buffer, 1, batch_count, fp);
+        batch_count = 0;
+    }
+
+    fflush(fp);
+}
+
+/* Queue pending batched log output, must be followed by uring_submit() */
+void log_queue(void)
+{
+    if ((fp == NULL) || (batch_count == 0))
+    {
+        return;
+    }
+
+    uring_write(fileno(fp), batch_buffer, batch_count, NULL);
+    batch_count = 0;
+}
+
 int log_open(const char *filename)
 {
     static char automatic_filename[400];
@@ -69,7 +132,8 @@ int log_open(const char *filename)
 
     log_filename = filename;
 
-    // Open log file in append write mode
+    // Open log file in append write mode, received data passed through is
+    // copied to it as splice() does not support append mode
     fp = fopen(filename, "a+");
     if (fp == NULL)
     {
@@ -156,7 +220,7 @@ void log_printf(const char *format, ...)
     vasprintf(&line, format, args);
     va_end(args);
 
-    fwrite(line, strlen(line), 1, fp);
+    log_output(line, strlen(line));
 
     free(line);
 }
@@ -172,12 +236,35 @@ void log_putc(char c)
     {
         if (!log_strip(c))
         {
-            fputc(c, fp);
+            log_output(&c, 1);
+        }
+    }
+    else
+    {
+        log_output(&c, 1);
+    }
+}
+
+void log_write(const char *buffer, size_t count)
+{
+    if (fp == NULL)
+    {
+        return;
+    }
+
+    if (option.log_strip)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (!log_strip(buffer[i]))
+            {
+                log_output(&buffer[i], 1);
+            }
         }
     }
     else
     {
-        fputc(c, fp);
+        log_output(buffer, count);
     }
 }
 
@@ -185,6 +272,7 @@ void log_close(void)
 {
     if (fp != NULL)
     {
+        log_flush();
         fclose(fp);
         fp = NULL;
         log_filename = NULL;
@@ -204,3 +292,16 @@ const char *log_get_filename(void)
 {
     return log_filename;
 }
+
+/* Returns log file descriptor with any buffered log data written out */
+int log_get_fd(void)
+{
+    if (fp == NULL)
+    {
+        return -1;
+    }
+
+    log_flush();
+
+    return fileno(fp);
+}
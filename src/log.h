@@ -21,9 +21,15 @@
 
 #pragma once
 
+#include <stddef.h>
+
 int log_open(const char *filename);
 void log_printf(const char *format, ...);
 void log_putc(char c);
+void log_write(const char *buffer, size_t count);
+void log_flush(void);
+void log_queue(void);
 void log_close(void);
 void log_exit(void);
 const char * log_get_filename(void);
+int log_get_fd(void);
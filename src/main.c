@@ -23,6 +23,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <string.h>
+#include <errno.h>
 #include "options.h"
 #include "configfile.h"
 #include "tty.h"
@@ -31,6 +33,11 @@
 #include "print.h"
 #include "signals.h"
 #include "socket.h"
+#include "event.h"
+#include "uring.h"
+#include "pace.h"
+#include "capture.h"
+#include "script.h"
 
 int main(int argc, char *argv[])
 {
@@ -60,6 +67,12 @@ int main(int argc, char *argv[])
     /* Configure tty device */
     tty_configure();
 
+    /* Load script to run when connected */
+    if (option.script_filename)
+    {
+        script_load(option.script_filename);
+    }
+
     /* Configure input terminal */
     if (isatty(fileno(stdin)))
     {
@@ -100,6 +113,9 @@ int main(int argc, char *argv[])
     /* Initialize ANSI text formatting (colors etc.) */
     print_init_ansi_formatting();
 
+    /* Initialize output buffer */
+    print_buffer_init();
+
     /* Change error printing mode */
     error_enter_session_mode();
 
@@ -114,6 +130,36 @@ int main(int argc, char *argv[])
         tio_printf("Press ctrl-c to quit");
     }
 
+    /* Initialize event loop */
+    if (event_init() < 0)
+    {
+        tio_error_printf("Could not initialize event loop (%s)", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    /* Set up timer for output pacing */
+    pace_init();
+
+    /* Batch output with io_uring if requested and supported */
+    if (option.io_uring)
+    {
+        if (uring_init() == 0)
+        {
+            tio_debug_printf("Using io_uring for output");
+        }
+        else
+        {
+            tio_warning_printf("io_uring not available, using regular writes");
+        }
+    }
+
+    /* Start capture of received data */
+    atexit(&capture_stop);
+    if (option.capture_filename)
+    {
+        capture_start(option.capture_filename);
+    }
+
     /* Open socket */
     if (option.socket)
     {
@@ -53,6 +53,23 @@ enum opt_t
     OPT_ALERT,
     OPT_COMPLETE_SUB_CONFIGS,
     OPT_MUTE,
+    OPT_HEX_FORMAT,
+    OPT_FLUSH_LATENCY,
+    OPT_IO_URING,
+    OPT_RX_BUFFER_SIZE,
+    OPT_STATS_INTERVAL,
+    OPT_OUTPUT_DRAIN,
+    OPT_OUTPUT_BUFFER_SIZE,
+    OPT_OUTPUT_QUEUE_DEPTH,
+    OPT_SEND_FILE,
+    OPT_RECEIVE_FILE,
+    OPT_TRANSFER_PROTOCOL,
+    OPT_CAPTURE,
+    OPT_SCRIPT,
+    OPT_SOCKET_QUEUE_SIZE,
+    OPT_SOCKET_SLOW_CLIENT,
+    OPT_SOCKET_MAX_CLIENTS,
+    OPT_SOCKET_SHM_SIZE,
 };
 
 /* Default options */
@@ -66,6 +83,17 @@ struct option_t option =
     .parity = "none",
     .output_delay = 0,
     .output_line_delay = 0,
+    .flush_latency = 0,
+    .io_uring = false,
+    .rx_buffer_size = 0,
+    .stats_interval = 0,
+    .output_drain = false,
+    .output_buffer_size = 65536,
+    .output_queue_depth = 0,
+    .socket_queue_size = 65536,
+    .socket_max_clients = 256,
+    .socket_shm_size = 0,
+    .socket_slow_client = SLOW_CLIENT_DROP,
     .dtr_pulse_duration = 100,
     .rts_pulse_duration = 100,
     .cts_pulse_duration = 100,
@@ -82,6 +110,7 @@ struct option_t option =
     .map = "",
     .color = 256, // Bold
     .hex_mode = false,
+    .hex_format = HEX_FORMAT_PLAIN,
     .prefix_code = 20, // ctrl-t
     .prefix_key = 't',
     .response_wait = false,
@@ -92,6 +121,11 @@ struct option_t option =
     .rs485_delay_rts_before_send = -1,
     .rs485_delay_rts_after_send = -1,
     .alert = ALERT_NONE,
+    .send_file = NULL,
+    .receive_file = NULL,
+    .capture_filename = NULL,
+    .script_filename = NULL,
+    .transfer_protocol = XMODEM_1K,
     .complete_sub_configs = false,
 };
 
@@ -112,6 +146,13 @@ void print_help(char *argv[])
     printf("  -o, --output-delay <ms>                Output character delay (default: 0)\n");
     printf("  -O, --output-line-delay <ms>           Output line delay (default: 0)\n");
     printf("      --line-pulse-duration <duration>   Set line pulse duration\n");
+    printf("      --output-drain                     Wait for output to be transmitted\n");
+    printf("      --output-buffer-size <bytes>       Maximum size of output buffer (default: 65536)\n");
+    printf("      --output-queue-depth <bytes>       Limit output queued in device driver (default: 0)\n");
+    printf("      --flush-latency <us>               Maximum delay of buffered output (default: 0)\n");
+    printf("      --io-uring                         Write received data via io_uring\n");
+    printf("      --rx-buffer-size <bytes>           Receive via reader thread and buffer (default: 0)\n");
+    printf("      --stats-interval <s>               Print statistics periodically (default: 0)\n");
     printf("  -n, --no-autoconnect                   Disable automatic connect\n");
     printf("  -e, --local-echo                       Enable local echo\n");
     printf("  -t, --timestamp                        Enable line timestamp\n");
@@ -120,16 +161,27 @@ void print_help(char *argv[])
     printf("  -l, --log                              Enable log to file\n");
     printf("      --log-file <filename>              Set log filename\n");
     printf("      --log-strip                        Strip control characters and escape sequences\n");
+    printf("      --capture <filename>               Capture raw received data to file\n");
+    printf("      --script <filename>                Run send/expect script\n");
     printf("  -m, --map <flags>                      Map characters\n");
     printf("  -c, --color 0..255|bold|none|list      Colorize tio text (default: bold)\n");
     printf("  -S, --socket <socket>                  Redirect I/O to socket\n");
+    printf("      --socket-max-clients <count>       Maximum number of socket clients (default: 256)\n");
+    printf("      --socket-queue-size <bytes>        Output queue size per socket client (default: 65536)\n");
+    printf("      --socket-slow-client drop|disconnect|block\n");
+    printf("                                         Handling of socket client with full queue (default: drop)\n");
+    printf("      --socket-shm-size <bytes>          Share received data in memory ring with local readers\n");
     printf("  -x, --hexadecimal                      Enable hexadecimal mode\n");
+    printf("      --hexadecimal-format plain|dump    Set hexadecimal format (default: plain)\n");
     printf("  -r, --response-wait                    Wait for line response then quit\n");
     printf("      --response-timeout <ms>            Response timeout (default: 100)\n");
     printf("      --rs-485                           Enable RS-485 mode\n");
     printf("      --rs-485-config <config>           Set RS-485 configuration\n");
     printf("      --alert bell|blink|none            Alert on connect/disconnect (default: none)\n");
     printf("      --mute                             Mute tio\n");
+    printf("      --send-file <filename>             Send file via transfer protocol then quit\n");
+    printf("      --receive-file <filename>          Receive file via transfer protocol then quit\n");
+    printf("      --transfer-protocol <protocol>     Set transfer protocol (default: xmodem-1k)\n");
     printf("  -v, --version                          Display version\n");
     printf("  -h, --help                             Display help\n");
     printf("\n");
@@ -206,6 +258,13 @@ void options_print()
     tio_printf(" Timestamp: %s", timestamp_state_to_string(option.timestamp));
     tio_printf(" Output delay: %d", option.output_delay);
     tio_printf(" Output line delay: %d", option.output_line_delay);
+    tio_printf(" Output drain: %s", option.output_drain ? "enabled" : "disabled");
+    tio_printf(" Output buffer size: %ld", option.output_buffer_size);
+    tio_printf(" Output queue depth: %ld", option.output_queue_depth);
+    tio_printf(" Flush latency: %ld", option.flush_latency);
+    tio_printf(" io_uring: %s", option.io_uring ? "enabled" : "disabled");
+    tio_printf(" Receive buffer size: %ld", option.rx_buffer_size);
+    tio_printf(" Statistics interval: %d", option.stats_interval);
     tio_printf(" Auto connect: %s", option.no_autoconnect ? "disabled" : "enabled");
     tio_printf(" Pulse duration: DTR=%d RTS=%d CTS=%d DSR=%d DCD=%d RI=%d", option.dtr_pulse_duration,
                                                                             option.rts_pulse_duration,
@@ -214,12 +273,25 @@ void options_print()
                                                                             option.dcd_pulse_duration,
                                                                             option.ri_pulse_duration);
     tio_printf(" Hexadecimal mode: %s", option.hex_mode ? "enabled" : "disabled");
+    tio_printf(" Hexadecimal format: %s", hex_format_to_string(option.hex_format));
     if (option.map[0] != 0)
         tio_printf(" Map flags: %s", option.map);
     if (option.log)
         tio_printf(" Log file: %s", log_get_filename());
     if (option.socket)
+    {
         tio_printf(" Socket: %s", option.socket);
+        tio_printf(" Socket max clients: %d", option.socket_max_clients);
+        tio_printf(" Socket queue size: %ld", option.socket_queue_size);
+        tio_printf(" Socket slow client: %s", socket_slow_client_to_string(option.socket_slow_client));
+        if (option.socket_shm_size > 0)
+            tio_printf(" Socket shared ring size: %ld", option.socket_shm_size);
+    }
+    if (option.capture_filename)
+        tio_printf(" Capture file: %s", option.capture_filename);
+    if (option.script_filename)
+        tio_printf(" Script file: %s", option.script_filename);
+    tio_printf(" Transfer protocol: %s", xymodem_mode_to_string(option.transfer_protocol));
 }
 
 void options_parse(int argc, char *argv[])
@@ -244,6 +316,13 @@ void options_parse(int argc, char *argv[])
             {"output-delay",         required_argument, 0, 'o'                     },
             {"output-line-delay" ,   required_argument, 0, 'O'                     },
             {"line-pulse-duration",  required_argument, 0, OPT_LINE_PULSE_DURATION },
+            {"output-drain",         no_argument,       0, OPT_OUTPUT_DRAIN        },
+            {"output-buffer-size",   required_argument, 0, OPT_OUTPUT_BUFFER_SIZE  },
+            {"output-queue-depth",   required_argument, 0, OPT_OUTPUT_QUEUE_DEPTH  },
+            {"flush-latency",        required_argument, 0, OPT_FLUSH_LATENCY       },
+            {"io-uring",             no_argument,       0, OPT_IO_URING            },
+            {"rx-buffer-size",       required_argument, 0, OPT_RX_BUFFER_SIZE      },
+            {"stats-interval",       required_argument, 0, OPT_STATS_INTERVAL      },
             {"no-autoconnect",       no_argument,       0, 'n'                     },
             {"local-echo",           no_argument,       0, 'e'                     },
             {"timestamp",            no_argument,       0, 't'                     },
@@ -256,12 +335,22 @@ void options_parse(int argc, char *argv[])
             {"map",                  required_argument, 0, 'm'                     },
             {"color",                required_argument, 0, 'c'                     },
             {"hexadecimal",          no_argument,       0, 'x'                     },
+            {"hexadecimal-format",   required_argument, 0, OPT_HEX_FORMAT          },
             {"response-wait",        no_argument,       0, 'r'                     },
             {"response-timeout",     required_argument, 0, OPT_RESPONSE_TIMEOUT    },
             {"rs-485",               no_argument,       0, OPT_RS485               },
             {"rs-485-config",        required_argument, 0, OPT_RS485_CONFIG        },
             {"alert",                required_argument, 0, OPT_ALERT               },
             {"mute",                 no_argument,       0, OPT_MUTE                },
+            {"send-file",            required_argument, 0, OPT_SEND_FILE           },
+            {"receive-file",         required_argument, 0, OPT_RECEIVE_FILE        },
+            {"transfer-protocol",    required_argument, 0, OPT_TRANSFER_PROTOCOL   },
+            {"capture",              required_argument, 0, OPT_CAPTURE             },
+            {"script",               required_argument, 0, OPT_SCRIPT              },
+            {"socket-max-clients",   required_argument, 0, OPT_SOCKET_MAX_CLIENTS  },
+            {"socket-queue-size",    required_argument, 0, OPT_SOCKET_QUEUE_SIZE   },
+            {"socket-slow-client",   required_argument, 0, OPT_SOCKET_SLOW_CLIENT  },
+            {"socket-shm-size",      required_argument, 0, OPT_SOCKET_SHM_SIZE     },
             {"version",              no_argument,       0, 'v'                     },
             {"help",                 no_argument,       0, 'h'                     },
             {"complete-sub-configs", no_argument,       0, OPT_COMPLETE_SUB_CONFIGS},
@@ -312,16 +401,79 @@ void options_parse(int argc, char *argv[])
 
             case 'o':
                 option.output_delay = string_to_long(optarg);
+                if (option.output_delay < 0)
+                {
+                    tio_error_printf("Invalid output delay");
+                    exit(EXIT_FAILURE);
+                }
                 break;
 
             case 'O':
                 option.output_line_delay = string_to_long(optarg);
+                if (option.output_line_delay < 0)
+                {
+                    tio_error_printf("Invalid output line delay");
+                    exit(EXIT_FAILURE);
+                }
                 break;
 
             case OPT_LINE_PULSE_DURATION:
                 line_pulse_duration_option_parse(optarg);
                 break;
 
+            case OPT_OUTPUT_DRAIN:
+                option.output_drain = true;
+                break;
+
+            case OPT_OUTPUT_BUFFER_SIZE:
+                option.output_buffer_size = string_to_long(optarg);
+                if (option.output_buffer_size <= 0)
+                {
+                    tio_error_printf("Invalid output buffer size");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_OUTPUT_QUEUE_DEPTH:
+                option.output_queue_depth = string_to_long(optarg);
+                if (option.output_queue_depth < 0)
+                {
+                    tio_error_printf("Invalid output queue depth");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_FLUSH_LATENCY:
+                option.flush_latency = string_to_long(optarg);
+                if (option.flush_latency < 0)
+                {
+                    tio_error_printf("Invalid flush latency");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_IO_URING:
+                option.io_uring = true;
+                break;
+
+            case OPT_RX_BUFFER_SIZE:
+                option.rx_buffer_size = string_to_long(optarg);
+                if (option.rx_buffer_size < 0)
+                {
+                    tio_error_printf("Invalid receive buffer size");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_STATS_INTERVAL:
+                option.stats_interval = string_to_long(optarg);
+                if (option.stats_interval < 0)
+                {
+                    tio_error_printf("Invalid statistics interval");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
             case 'n':
                 option.no_autoconnect = true;
                 break;
@@ -397,6 +549,10 @@ void options_parse(int argc, char *argv[])
                 option.hex_mode = true;
                 break;
 
+            case OPT_HEX_FORMAT:
+                option.hex_format = hex_format_option_parse(optarg);
+                break;
+
             case 'r':
                 option.response_wait = true;
                 break;
@@ -421,6 +577,57 @@ void options_parse(int argc, char *argv[])
                 option.mute = true;
                 break;
 
+            case OPT_SEND_FILE:
+                option.send_file = optarg;
+                break;
+
+            case OPT_RECEIVE_FILE:
+                option.receive_file = optarg;
+                break;
+
+            case OPT_TRANSFER_PROTOCOL:
+                option.transfer_protocol = xymodem_option_parse(optarg);
+                break;
+
+            case OPT_CAPTURE:
+                option.capture_filename = optarg;
+                break;
+
+            case OPT_SCRIPT:
+                option.script_filename = optarg;
+                break;
+
+            case OPT_SOCKET_MAX_CLIENTS:
+                option.socket_max_clients = string_to_long(optarg);
+                if (option.socket_max_clients <= 0)
+                {
+                    tio_error_printf("Invalid maximum number of socket clients");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_SOCKET_QUEUE_SIZE:
+                option.socket_queue_size = string_to_long(optarg);
+                if (option.socket_queue_size <= 0)
+                {
+                    tio_error_printf("Invalid socket queue size");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_SOCKET_SLOW_CLIENT:
+                option.socket_slow_client = socket_slow_client_option_parse(optarg);
+                break;
+
+            case OPT_SOCKET_SHM_SIZE:
+                option.socket_shm_size = string_to_long(optarg);
+                if (option.socket_shm_size < 0)
+                {
+                    tio_error_printf("Invalid shared ring size");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
             case 'v':
                 printf("tio v%s\n", VERSION);
                 exit(EXIT_SUCCESS);
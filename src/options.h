@@ -28,6 +28,14 @@
 #include <sys/param.h>
 #include "timestamp.h"
 #include "alert.h"
+#include "xymodem.h"
+#include "socket.h"
+
+enum hex_format_t
+{
+    HEX_FORMAT_PLAIN,
+    HEX_FORMAT_DUMP,
+};
 
 /* Options */
 struct option_t
@@ -40,6 +48,17 @@ struct option_t
     char *parity;
     int output_delay;
     int output_line_delay;
+    long flush_latency;
+    long rx_buffer_size;
+    int stats_interval;
+    bool output_drain;
+    bool io_uring;
+    long output_buffer_size;
+    long output_queue_depth;
+    long socket_queue_size;
+    int socket_max_clients;
+    long socket_shm_size;
+    enum socket_slow_client_t socket_slow_client;
     unsigned int dtr_pulse_duration;
     unsigned int rts_pulse_duration;
     unsigned int cts_pulse_duration;
@@ -56,6 +75,7 @@ struct option_t
     const char *socket;
     int color;
     bool hex_mode;
+    enum hex_format_t hex_format;
     unsigned char prefix_code;
     unsigned char prefix_key;
     bool response_wait;
@@ -66,6 +86,11 @@ struct option_t
     int32_t rs485_delay_rts_before_send;
     int32_t rs485_delay_rts_after_send;
     enum alert_t alert;
+    const char *send_file;
+    const char *receive_file;
+    const char *capture_filename;
+    const char *script_filename;
+    enum xymodem_mode_t transfer_protocol;
     bool complete_sub_configs;
 };
 
@@ -0,0 +1,266 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Output pacing scheduler for output-delay, output-line-delay and
+ * output-queue-depth
+ *
+ * Each character is released at an absolute deadline on CLOCK_MONOTONIC.
+ * The next deadline is derived from the previous one rather than from the
+ * time the character was actually written, so wakeup latency does not
+ * accumulate into drift. Where timerfd is available the deadline is armed
+ * on a timer registered with the event loop, otherwise the event loop
+ * timeout is used.
+ *
+ * The same deadline is used to defer output until the device driver queue
+ * has drained, estimated from the time it takes to transmit a character.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "pace.h"
+#include "event.h"
+#include "options.h"
+#include "print.h"
+
+#ifdef HAVE_TIMERFD
+#include <sys/timerfd.h>
+#endif
+
+#define NSEC_PER_SEC 1000000000LL
+#define NSEC_PER_MSEC 1000000LL
+
+static struct timespec deadline;
+static bool armed = false;
+static int64_t char_time = 0;
+static int timer_fd = -1;
+
+static void timespec_add(struct timespec *ts, int64_t ns)
+{
+    ts->tv_sec += ns / NSEC_PER_SEC;
+    ts->tv_nsec += ns % NSEC_PER_SEC;
+    if (ts->tv_nsec >= NSEC_PER_SEC)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= NSEC_PER_SEC;
+    }
+}
+
+/* Return a - b in nanoseconds */
+static int64_t timespec_diff(const struct timespec *a, const struct timespec *b)
+{
+    return (a->tv_sec - b->tv_sec) * NSEC_PER_SEC + (a->tv_nsec - b->tv_nsec);
+}
+
+static void pace_arm(void)
+{
+    armed = true;
+
+#ifdef HAVE_TIMERFD
+    struct itimerspec its = { .it_value = deadline };
+
+    if (timer_fd >= 0)
+    {
+        timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+    }
+#endif
+}
+
+void pace_init(void)
+{
+#ifdef HAVE_TIMERFD
+    if (!pace_enabled() && (option.output_queue_depth <= 0))
+    {
+        return;
+    }
+
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0)
+    {
+        tio_debug_printf("Could not create pacing timer (%s)", strerror(errno));
+        return;
+    }
+
+    if (event_add(timer_fd, EVENT_READ) < 0)
+    {
+        close(timer_fd);
+        timer_fd = -1;
+    }
+#endif
+}
+
+/* Estimate time it takes to transmit one character at current port settings */
+void pace_configure(void)
+{
+    int bits = 1 + option.databits + option.stopbits;
+
+    if (strcmp(option.parity, "none") != 0)
+    {
+        bits++;
+    }
+
+    char_time = (option.baudrate > 0) ? (bits * NSEC_PER_SEC / option.baudrate) : 0;
+
+    pace_reset();
+}
+
+/* Forget schedule so next character is released immediately */
+void pace_reset(void)
+{
+    deadline.tv_sec = 0;
+    deadline.tv_nsec = 0;
+    armed = false;
+
+#ifdef HAVE_TIMERFD
+    struct itimerspec its = { 0 };
+
+    if (timer_fd >= 0)
+    {
+        // Disarming also clears any pending expiration
+        timerfd_settime(timer_fd, 0, &its, NULL);
+    }
+#endif
+}
+
+bool pace_enabled(void)
+{
+    return (option.output_delay > 0) || (option.output_line_delay > 0);
+}
+
+/* Return true if next character may be written, otherwise arm timer for its deadline */
+bool pace_due(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (timespec_diff(&now, &deadline) >= 0)
+    {
+        armed = false;
+        return true;
+    }
+
+    if (!armed)
+    {
+        pace_arm();
+    }
+
+    return false;
+}
+
+/* Schedule deadline of next character after character c was written */
+void pace_next(char c)
+{
+    struct timespec now;
+    int64_t interval = char_time + option.output_delay * NSEC_PER_MSEC;
+
+    if (c == '\n')
+    {
+        interval += option.output_line_delay * NSEC_PER_MSEC;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    /* Keep to schedule unless output has been idle or stalled for longer
+     * than one interval, in which case start a new schedule from now */
+    if (timespec_diff(&now, &deadline) >= interval)
+    {
+        deadline = now;
+    }
+
+    timespec_add(&deadline, interval);
+}
+
+/* Defer output until the given number of characters has been transmitted */
+void pace_defer(size_t count)
+{
+    // Wake up at least every millisecond if character time is unknown
+    int64_t interval = (char_time > 0) ? (count * char_time) : NSEC_PER_MSEC;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    timespec_add(&deadline, interval);
+    pace_arm();
+}
+
+/* Block until next character is due */
+void pace_sleep(void)
+{
+#if defined(__APPLE__)
+    struct timespec now, ts;
+    int64_t remaining;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    remaining = timespec_diff(&deadline, &now);
+    if (remaining > 0)
+    {
+        ts.tv_sec = remaining / NSEC_PER_SEC;
+        ts.tv_nsec = remaining % NSEC_PER_SEC;
+        nanosleep(&ts, NULL);
+    }
+#else
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+#endif
+}
+
+/* Return timer file descriptor or -1 if event loop timeout is used instead */
+int pace_fd(void)
+{
+    return timer_fd;
+}
+
+void pace_acknowledge(void)
+{
+    uint64_t expirations;
+
+    if (timer_fd >= 0)
+    {
+        while (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno == EINTR);
+    }
+}
+
+/* Return time in microseconds until next character is due, or -1 if no
+ * wakeup is needed from event loop timeout */
+long pace_timeout(void)
+{
+    struct timespec now;
+    int64_t remaining;
+
+    if (!armed || (timer_fd >= 0))
+    {
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    remaining = timespec_diff(&deadline, &now);
+    if (remaining <= 0)
+    {
+        return 0;
+    }
+
+    // Round up so wakeup does not happen before deadline
+    return (remaining + 999) / 1000;
+}
@@ -0,0 +1,332 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Zero-copy forwarding of received data.
+ *
+ * When received data needs no transformation it is moved from the tty
+ * device into a pipe with splice() and from there to stdout and any socket
+ * clients. Each destination but the last gets its own copy via tee() into a
+ * scratch pipe so the data never passes through user space buffers. The log
+ * file is opened in append mode which splice() does not support, so its copy
+ * is written out through a small buffer.
+ */
+
+#define _GNU_SOURCE
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/param.h>
+#include "passthrough.h"
+#include "print.h"
+#include "log.h"
+#include "socket.h"
+
+#ifdef HAVE_SPLICE
+
+#define PASSTHROUGH_CHUNK_SIZE 65536    // Default pipe capacity
+static int pipe_main[2] = { -1, -1 };
+static int pipe_scratch[2] = { -1, -1 };
+static bool stdout_splice = true;
+static int *clientfds = NULL;
+static int clientfds_size = 0;
+
+static int passthrough_init(void)
+{
+    if (pipe_main[0] != -1)
+    {
+        return 0;
+    }
+
+    if (pipe2(pipe_main, O_CLOEXEC) < 0)
+    {
+        return -1;
+    }
+
+    if (pipe2(pipe_scratch, O_CLOEXEC) < 0)
+    {
+        close(pipe_main[0]);
+        close(pipe_main[1]);
+        pipe_main[0] = pipe_main[1] = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Discard bytes left in pipe */
+static void pipe_drain(int pipe_in, size_t count)
+{
+    char buffer[BUFSIZ];
+    ssize_t status;
+
+    while (count > 0)
+    {
+        status = read(pipe_in, buffer, MIN(count, sizeof(buffer)));
+        if (status <= 0)
+        {
+            break;
+        }
+        count -= status;
+    }
+}
+
+/* Copy bytes from pipe via user space for destinations which do not support splice */
+static int pipe_copy(int pipe_in, int fd_out, size_t count)
+{
+    char buffer[BUFSIZ];
+    ssize_t status, written;
+
+    while (count > 0)
+    {
+        status = read(pipe_in, buffer, MIN(count, sizeof(buffer)));
+        if (status <= 0)
+        {
+            pipe_drain(pipe_in, count);
+            return -1;
+        }
+        count -= status;
+
+        for (ssize_t i = 0; i < status; i += written)
+        {
+            written = write(fd_out, buffer + i, status - i);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    written = 0;
+                    continue;
+                }
+                pipe_drain(pipe_in, count);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* Move count bytes from pipe to destination, leaving the pipe empty */
+static int pipe_splice(int pipe_in, int fd_out, size_t count, bool *use_splice)
+{
+    ssize_t status;
+
+    while (count > 0)
+    {
+        if ((use_splice != NULL) && !*use_splice)
+        {
+            return pipe_copy(pipe_in, fd_out, count);
+        }
+
+        status = splice(pipe_in, NULL, fd_out, NULL, count, SPLICE_F_MOVE);
+        if (status < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if ((errno == EINVAL) && (use_splice != NULL))
+            {
+                /* Destination does not support splice, copy instead from now on */
+                *use_splice = false;
+                continue;
+            }
+            pipe_drain(pipe_in, count);
+            return -1;
+        }
+        count -= status;
+    }
+
+    return 0;
+}
+
+/* Duplicate pipe content into empty scratch pipe. As tee() does not consume
+ * its input it always copies from the start of the main pipe, so anything
+ * short of the full content can not be completed and is an error. */
+static int pipe_tee_scratch(size_t count)
+{
+    ssize_t status;
+
+    do
+    {
+        status = tee(pipe_main[0], pipe_scratch[1], count, 0);
+    }
+    while ((status < 0) && (errno == EINTR));
+
+    if (status == (ssize_t) count)
+    {
+        return 0;
+    }
+
+    if (status > 0)
+    {
+        pipe_drain(pipe_scratch[0], status);
+    }
+    if (status >= 0)
+    {
+        errno = EIO;
+    }
+
+    return -1;
+}
+
+/* Duplicate pipe content to socket client, splicing what the client accepts
+ * right away and handing the rest to its output queue */
+static int pipe_tee_client(int fd_out, size_t count)
+{
+    char buffer[BUFSIZ];
+    ssize_t status;
+
+    if (pipe_tee_scratch(count) < 0)
+    {
+        return -1;
+    }
+
+    /* Queued output must go first */
+    while ((count > 0) && socket_client_idle(fd_out))
+    {
+        status = splice(pipe_scratch[0], NULL, fd_out, NULL, count, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (status < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN)
+            {
+                break;
+            }
+            pipe_drain(pipe_scratch[0], count);
+            return -1;
+        }
+        socket_client_sent(fd_out, status);
+        count -= status;
+    }
+
+    while (count > 0)
+    {
+        status = read(pipe_scratch[0], buffer, MIN(count, sizeof(buffer)));
+        if (status < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            pipe_drain(pipe_scratch[0], count);
+            return -1;
+        }
+        if (status == 0)
+        {
+            errno = EIO;
+            return -1;
+        }
+        socket_write_client(fd_out, buffer, status);
+        count -= status;
+    }
+
+    return 0;
+}
+
+/*
+ * Forward available input from fd to all destinations.
+ *
+ * Returns number of bytes forwarded or -1 on error. Fails with errno set to
+ * EAGAIN if there is no input available and EINVAL or ENOSYS if splicing
+ * from fd is not supported, in which case no input has been consumed.
+ */
+ssize_t passthrough_forward(int fd)
+{
+    int numclients, logfd;
+    int *fds;
+    ssize_t count;
+
+    if (passthrough_init() < 0)
+    {
+        errno = ENOSYS;
+        return -1;
+    }
+
+    /* Move input into pipe */
+    do
+    {
+        count = splice(fd, NULL, pipe_main[1], NULL, PASSTHROUGH_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    }
+    while ((count < 0) && (errno == EINTR));
+
+    if (count <= 0)
+    {
+        return count;
+    }
+
+    /* Copy to socket clients */
+    numclients = socket_client_count();
+    if (numclients > clientfds_size)
+    {
+        fds = realloc(clientfds, numclients * sizeof(int));
+        if (fds != NULL)
+        {
+            clientfds = fds;
+            clientfds_size = numclients;
+        }
+    }
+    numclients = socket_get_clientfds(clientfds, clientfds_size);
+    for (int i = 0; i < numclients; i++)
+    {
+        if (pipe_tee_client(clientfds[i], count) < 0)
+        {
+            tio_error_printf_silent("Failed to write to socket (%s)", strerror(errno));
+            socket_close_clientfd(clientfds[i]);
+        }
+    }
+
+    /* Copy to log file, which is opened in append mode and so can not be
+     * spliced to */
+    logfd = option.log ? log_get_fd() : -1;
+    if (logfd >= 0)
+    {
+        if ((pipe_tee_scratch(count) < 0) || (pipe_copy(pipe_scratch[0], logfd, count) < 0))
+        {
+            tio_warning_printf("Could not write to log file (%s)", strerror(errno));
+        }
+    }
+
+    /* Finally move to stdout */
+    pipe_splice(pipe_main[0], STDOUT_FILENO, count, &stdout_splice);
+
+    return count;
+}
+
+#else
+
+ssize_t passthrough_forward(int fd)
+{
+    (void) fd;
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif
@@ -22,21 +22,438 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdarg.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
 #include "options.h"
 #include "print.h"
+#include "error.h"
+#include "uring.h"
+
+#define PRINT_BUFFER_SIZE (BUFSIZ*4)
 
 bool print_tainted = false;
 char ansi_format[30];
 
+#define HEXDUMP_ROW_SIZE 16
+#define HEXDUMP_ROW_LENGTH 60  // Hex and ASCII columns including line ending
+
+static char print_buffer[PRINT_BUFFER_SIZE];
+static size_t print_buffer_count = 0;
+static struct timespec print_buffer_time;
+static pthread_t print_buffer_owner;
+static unsigned long hexdump_offset = 0;
+static unsigned int hexdump_column = 0;
+static char hexdump_ascii[HEXDUMP_ROW_SIZE];
+
+/* Two character hexadecimal representation of each byte value */
+static const char hex_table[] =
+    "000102030405060708090a0b0c0d0e0f"
+    "101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f"
+    "303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f"
+    "505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f"
+    "707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f"
+    "909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeaf"
+    "b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"
+    "d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+    "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+static void print_write(const char *buffer, size_t count)
+{
+    ssize_t status;
+
+    while (count > 0)
+    {
+        status = write(STDOUT_FILENO, buffer, count);
+        if (status < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN)
+            {
+                /* Wait for stdout to drain */
+                struct pollfd pfd = { .fd = STDOUT_FILENO, .events = POLLOUT };
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            tio_debug_printf("Write error while flushing output buffer (%s)", strerror(errno));
+            break;
+        }
+        buffer += status;
+        count -= status;
+    }
+}
+
+static inline void print_buffer_mark(void)
+{
+    /* Remember when first byte entered the empty buffer */
+    if (print_buffer_count == 0)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &print_buffer_time);
+    }
+}
+
+void print_buffer_init(void)
+{
+    /* Only the thread doing the output rendering may touch the buffer */
+    print_buffer_owner = pthread_self();
+}
+
+void print_buffer_flush(void)
+{
+    if (!pthread_equal(pthread_self(), print_buffer_owner))
+    {
+        return;
+    }
+
+    /* Let output still in flight via io_uring and stdio go first to keep order */
+    uring_wait(STDOUT_FILENO);
+    fflush(stdout);
+
+    if (print_buffer_count > 0)
+    {
+        print_write(print_buffer, print_buffer_count);
+        print_buffer_count = 0;
+    }
+}
+
+/* Queue buffered output for batched submission, must be followed by uring_submit() */
+void print_buffer_queue(void)
+{
+    if (!uring_enabled())
+    {
+        print_buffer_flush();
+        return;
+    }
+
+    if (!pthread_equal(pthread_self(), print_buffer_owner))
+    {
+        return;
+    }
+
+    fflush(stdout);
+
+    if (print_buffer_count > 0)
+    {
+        uring_write(STDOUT_FILENO, print_buffer, print_buffer_count, NULL);
+        print_buffer_count = 0;
+    }
+}
+
+/*
+ * Return time in microseconds until pending output is due to be flushed
+ * according to the configured flush latency, or -1 if nothing is pending.
+ */
+long print_buffer_flush_timeout(void)
+{
+    struct timespec now;
+    long elapsed;
+
+    if (print_buffer_count == 0)
+    {
+        return -1;
+    }
+
+    if (option.flush_latency <= 0)
+    {
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec - print_buffer_time.tv_sec) * 1000000 +
+              (now.tv_nsec - print_buffer_time.tv_nsec) / 1000;
+
+    return (elapsed >= option.flush_latency) ? 0 : option.flush_latency - elapsed;
+}
+
+void print_buffer_putc(char c)
+{
+    if (print_buffer_count == PRINT_BUFFER_SIZE)
+    {
+        print_buffer_flush();
+    }
+    print_buffer_mark();
+    print_buffer[print_buffer_count++] = c;
+}
+
+void print_buffer_write(const char *buffer, size_t count)
+{
+    if ((print_buffer_count + count) > PRINT_BUFFER_SIZE)
+    {
+        print_buffer_flush();
+
+        if (count > PRINT_BUFFER_SIZE)
+        {
+            /* Too large to buffer, write directly */
+            print_write(buffer, count);
+            return;
+        }
+    }
+
+    print_buffer_mark();
+    memcpy(print_buffer + print_buffer_count, buffer, count);
+    print_buffer_count += count;
+}
+
+static char *print_buffer_reserve(size_t count)
+{
+    if ((print_buffer_count + count) > PRINT_BUFFER_SIZE)
+    {
+        print_buffer_flush();
+    }
+    print_buffer_mark();
+    return print_buffer + print_buffer_count;
+}
+
+static inline char *hex_encode(char *p, unsigned char c)
+{
+    p[0] = hex_table[c * 2];
+    p[1] = hex_table[c * 2 + 1];
+    return p + 2;
+}
+
+static inline char hexdump_ascii_char(unsigned char c)
+{
+    return ((c >= 0x20) && (c < 0x7f)) ? c : '.';
+}
+
+void print_buffer_hex_write(const char *buffer, size_t count)
+{
+    size_t i, block;
+    char *p;
+
+    while (count > 0)
+    {
+        block = MIN(count, PRINT_BUFFER_SIZE / 3);
+        p = print_buffer_reserve(block * 3);
+
+        for (i = 0; i < block; i++)
+        {
+            p = hex_encode(p, buffer[i]);
+            *p++ = ' ';
+        }
+
+        print_buffer_count += block * 3;
+        buffer += block;
+        count -= block;
+    }
+}
+
+void print_buffer_hex(char c)
+{
+    print_buffer_hex_write(&c, 1);
+}
+
+static void hexdump_row_begin(void)
+{
+    if (option.timestamp)
+    {
+        char *now = timestamp_current_time();
+        if (now)
+        {
+            ansi_print_buffer_printf_raw("[%s] ", now);
+        }
+    }
+    print_buffer_printf("%08lx: ", hexdump_offset);
+}
+
+static void hexdump_row_end(void)
+{
+    char *p = print_buffer_reserve(HEXDUMP_ROW_LENGTH);
+    char *start = p;
+    unsigned int written = hexdump_column * 2 + hexdump_column / 2;
+
+    /* Pad hex column of incomplete row */
+    for (unsigned int i = written; i <= HEXDUMP_ROW_SIZE * 5 / 2; i++)
+    {
+        *p++ = ' ';
+    }
+
+    memcpy(p, hexdump_ascii, hexdump_column);
+    p += hexdump_column;
+    *p++ = '\r';
+    *p++ = '\n';
+
+    print_buffer_count += p - start;
+    hexdump_offset += hexdump_column;
+    hexdump_column = 0;
+}
+
+/* Encode a complete row in one go */
+static void hexdump_row(const unsigned char *row)
+{
+    char *p = print_buffer_reserve(HEXDUMP_ROW_LENGTH);
+    char *start = p;
+
+    for (int i = 0; i < HEXDUMP_ROW_SIZE; i += 2)
+    {
+        p = hex_encode(p, row[i]);
+        p = hex_encode(p, row[i + 1]);
+        *p++ = ' ';
+    }
+    *p++ = ' ';
+
+    for (int i = 0; i < HEXDUMP_ROW_SIZE; i++)
+    {
+        *p++ = hexdump_ascii_char(row[i]);
+    }
+    *p++ = '\r';
+    *p++ = '\n';
+
+    print_buffer_count += p - start;
+    hexdump_offset += HEXDUMP_ROW_SIZE;
+}
+
+void print_buffer_hexdump(const char *buffer, size_t count)
+{
+    const unsigned char *data = (const unsigned char *) buffer;
+    size_t i = 0;
+    char *p;
+
+    while (i < count)
+    {
+        if (hexdump_column == 0)
+        {
+            hexdump_row_begin();
+
+            if ((count - i) >= HEXDUMP_ROW_SIZE)
+            {
+                hexdump_row(data + i);
+                i += HEXDUMP_ROW_SIZE;
+                continue;
+            }
+        }
+
+        /* Fill incomplete row byte by byte */
+        p = print_buffer_reserve(3);
+        p = hex_encode(p, data[i]);
+        print_buffer_count += 2;
+        if (hexdump_column & 1)
+        {
+            *p = ' ';
+            print_buffer_count++;
+        }
+        hexdump_ascii[hexdump_column++] = hexdump_ascii_char(data[i]);
+        i++;
+
+        if (hexdump_column == HEXDUMP_ROW_SIZE)
+        {
+            hexdump_row_end();
+        }
+    }
+}
+
+void print_hexdump_end(void)
+{
+    if (hexdump_column > 0)
+    {
+        hexdump_row_end();
+    }
+}
+
+void print_hexdump_reset(void)
+{
+    print_hexdump_end();
+    hexdump_offset = 0;
+}
+
+enum hex_format_t hex_format_option_parse(const char *arg)
+{
+    enum hex_format_t hex_format = option.hex_format; // Default
+
+    if (arg != NULL)
+    {
+        if (strcmp(arg, "plain") == 0)
+        {
+            return HEX_FORMAT_PLAIN;
+        }
+        else if (strcmp(arg, "dump") == 0)
+        {
+            return HEX_FORMAT_DUMP;
+        }
+        else
+        {
+            tio_error_printf("Invalid hexadecimal format option '%s'", arg);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return hex_format;
+}
+
+const char *hex_format_to_string(enum hex_format_t hex_format)
+{
+    switch (hex_format)
+    {
+        case HEX_FORMAT_PLAIN:
+            return "plain";
+        case HEX_FORMAT_DUMP:
+            return "dump";
+        default:
+            return "unknown";
+    }
+}
+
+void print_buffer_printf(const char *format, ...)
+{
+    va_list args;
+    int length;
+
+    print_buffer_mark();
+
+    va_start(args, format);
+    length = vsnprintf(print_buffer + print_buffer_count, PRINT_BUFFER_SIZE - print_buffer_count, format, args);
+    va_end(args);
+
+    if (length < 0)
+    {
+        return;
+    }
+
+    if ((size_t) length >= (PRINT_BUFFER_SIZE - print_buffer_count))
+    {
+        /* Did not fit, flush and retry in empty buffer */
+        print_buffer_flush();
+        print_buffer_mark();
+
+        va_start(args, format);
+        length = vsnprintf(print_buffer, PRINT_BUFFER_SIZE, format, args);
+        va_end(args);
+
+        if (length < 0)
+        {
+            return;
+        }
+        if (length >= PRINT_BUFFER_SIZE)
+        {
+            length = PRINT_BUFFER_SIZE - 1;
+        }
+    }
+
+    print_buffer_count += length;
+}
+
 void print_hex(char c)
 {
-    printf("%02x ", (unsigned char) c);
+    print_buffer_hex(c);
 }
 
 void print_normal(char c)
 {
-    putchar(c);
+    print_buffer_putc(c);
 }
 
 void print_init_ansi_formatting()
@@ -35,6 +35,7 @@ extern char ansi_format[];
 
 #define ansi_printf(format, args...) \
 { \
+    print_buffer_flush(); \
     if (!option.mute) \
     { \
         if (option.color < 0) \
@@ -46,6 +47,7 @@ extern char ansi_format[];
 
 #define ansi_error_printf(format, args...) \
 { \
+    print_buffer_flush(); \
     if (!option.mute) \
     { \
         if (option.color < 0) \
@@ -58,6 +60,7 @@ extern char ansi_format[];
 
 #define ansi_printf_raw(format, args...) \
 { \
+    print_buffer_flush(); \
     if (!option.mute) \
     { \
         if (option.color < 0) \
@@ -67,8 +70,20 @@ extern char ansi_format[];
     } \
 }
 
+#define ansi_print_buffer_printf_raw(format, args...) \
+{ \
+    if (!option.mute) \
+    { \
+        if (option.color < 0) \
+        print_buffer_printf(format, ## args); \
+        else \
+        print_buffer_printf("%s" format ANSI_RESET, ansi_format, ## args); \
+    } \
+}
+
 #define tio_warning_printf(format, args...) \
 { \
+    print_buffer_flush(); \
     if (!option.mute) \
     { \
         if (print_tainted) \
@@ -82,6 +97,7 @@ extern char ansi_format[];
 
 #define tio_printf(format, args...) \
 { \
+    print_buffer_flush(); \
     if (!option.mute) \
     { \
         if (print_tainted) \
@@ -93,6 +109,7 @@ extern char ansi_format[];
 
 #define tio_printf_raw(format, args...) \
 { \
+    print_buffer_flush(); \
     if (!option.mute) \
     { \
         if (print_tainted) \
@@ -115,4 +132,18 @@ extern char ansi_format[];
 void print_hex(char c);
 void print_normal(char c);
 void print_init_ansi_formatting(void);
+void print_buffer_putc(char c);
+void print_buffer_write(const char *buffer, size_t count);
+void print_buffer_hex(char c);
+void print_buffer_hex_write(const char *buffer, size_t count);
+void print_buffer_hexdump(const char *buffer, size_t count);
+void print_hexdump_end(void);
+void print_hexdump_reset(void);
+enum hex_format_t hex_format_option_parse(const char *arg);
+const char *hex_format_to_string(enum hex_format_t hex_format);
+void print_buffer_printf(const char *format, ...);
+void print_buffer_flush(void);
+void print_buffer_queue(void);
+long print_buffer_flush_timeout(void);
+void print_buffer_init(void);
 void tio_printf_array(const char *array);
@@ -0,0 +1,111 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Lock-free single producer, single consumer ring buffer
+ *
+ * Head and tail are free running byte counters which are only ever written
+ * by the producer and consumer respectively. The producer writes directly
+ * into the free space of the ring and the consumer processes data in place,
+ * so data is never copied between threads.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ring.h"
+
+int ring_init(struct ring_t *ring, size_t size)
+{
+    size_t ring_size = 1;
+
+    /* Round up to power of two so counters can be masked */
+    while (ring_size < size)
+    {
+        ring_size <<= 1;
+    }
+
+    memset(ring, 0, sizeof(*ring));
+
+    ring->buffer = malloc(ring_size);
+    if (ring->buffer == NULL)
+    {
+        return -1;
+    }
+    ring->size = ring_size;
+
+    return 0;
+}
+
+void ring_free(struct ring_t *ring)
+{
+    free(ring->buffer);
+    memset(ring, 0, sizeof(*ring));
+}
+
+/* Return contiguous free space available to producer */
+size_t ring_write_space(struct ring_t *ring, char **pointer)
+{
+    size_t head = ring->head;
+    size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+    size_t offset = head & (ring->size - 1);
+    size_t space = ring->size - (head - tail);
+
+    *pointer = ring->buffer + offset;
+
+    return (space < ring->size - offset) ? space : ring->size - offset;
+}
+
+/* Publish count bytes written by producer, returns true if ring was empty */
+bool ring_commit(struct ring_t *ring, size_t count)
+{
+    size_t head = ring->head + count;
+    size_t used;
+
+    __atomic_store_n(&ring->head, head, __ATOMIC_SEQ_CST);
+
+    /* Pairs with ring_release() so that either side sees the other's update */
+    used = head - __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+    if (used > ring->high_water)
+    {
+        ring->high_water = used;
+    }
+
+    return used == count;
+}
+
+/* Return contiguous data available to consumer */
+size_t ring_read_space(struct ring_t *ring, char **pointer)
+{
+    size_t tail = ring->tail;
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+    size_t offset = tail & (ring->size - 1);
+    size_t available = head - tail;
+
+    *pointer = ring->buffer + offset;
+
+    return (available < ring->size - offset) ? available : ring->size - offset;
+}
+
+/* Hand count bytes processed by consumer back to producer */
+void ring_release(struct ring_t *ring, size_t count)
+{
+    __atomic_store_n(&ring->tail, ring->tail + count, __ATOMIC_SEQ_CST);
+}
@@ -0,0 +1,42 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Lock-free single producer, single consumer ring buffer */
+struct ring_t
+{
+    char *buffer;
+    size_t size;
+    size_t head;        // Written by producer only
+    size_t tail;        // Written by consumer only
+    size_t high_water;
+};
+
+int ring_init(struct ring_t *ring, size_t size);
+void ring_free(struct ring_t *ring);
+size_t ring_write_space(struct ring_t *ring, char **pointer);
+bool ring_commit(struct ring_t *ring, size_t count);
+size_t ring_read_space(struct ring_t *ring, char **pointer);
+void ring_release(struct ring_t *ring, size_t count);
@@ -0,0 +1,836 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Send/expect scripts
+ *
+ * A script is a list of steps read from file, one per line:
+ *
+ *   send <string>                      Send string to device
+ *   expect <string> [<label>] ...      Wait for any of the strings, then
+ *                                      continue at its label or next step
+ *   timeout <ms> [<label>]             Set time limit of following expects
+ *                                      and where to continue when exceeded
+ *   sleep <ms>                         Wait before next step
+ *   goto <label>                       Continue at label
+ *   exit <status>                      Quit tio with exit status
+ *   <label>:                           Mark position to continue at
+ *
+ * Strings are double quoted and support \r, \n, \t, \e, \\, \" and \xHH
+ * escapes. Lines starting with # are comments.
+ *
+ * The strings of each expect step are compiled into one Aho-Corasick
+ * automaton when loading, so received data is matched against all of them
+ * in a single pass with one table lookup per byte.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include "script.h"
+#include "tty.h"
+#include "print.h"
+
+#define DEFAULT_TIMEOUT 10000   // ms
+#define TOKENS_MAX 64
+#define PENDING_MAX 4096        // Received data kept for next expect step
+#define STEPS_PER_RUN 256       // Steps run before giving the main loop a turn
+
+enum step_type_t
+{
+    STEP_SEND,
+    STEP_EXPECT,
+    STEP_TIMEOUT,
+    STEP_SLEEP,
+    STEP_GOTO,
+    STEP_EXIT,
+};
+
+struct automaton_t
+{
+    int (*next)[256];
+    int *match;             // Pattern completed in state or -1
+};
+
+struct step_t
+{
+    enum step_type_t type;
+    int line;
+    char *data;             // Send string
+    size_t length;
+    int patterns;           // Expect strings
+    int *targets;           // Step to continue at per pattern or -1
+    char **target_labels;   // Until resolved
+    struct automaton_t automaton;
+    long value;             // Timeout, sleep time or exit status
+    int target;             // Step to continue at or -1
+    char *target_label;     // Until resolved
+
+    /* Response time of expect steps */
+    unsigned long matches;
+    unsigned long timeouts;
+    int64_t time_total;     // us
+    int64_t time_min;
+    int64_t time_max;
+};
+
+struct token_t
+{
+    char *text;
+    size_t length;
+    bool quoted;
+};
+
+struct label_t
+{
+    char *name;
+    int step;
+};
+
+/* Loaded script */
+static struct step_t *steps = NULL;
+static int step_count = 0;
+static struct label_t *labels = NULL;
+static int label_count = 0;
+static const char *script_filename;
+
+/* Script execution state */
+static bool active = false;
+static bool waiting = false;
+static int current;
+static int state;
+static int matched = -1;
+static long timeout;
+static int timeout_target;
+static struct timespec step_start;
+static struct timespec deadline;
+static char pending[PENDING_MAX];
+static size_t pending_count = 0;
+
+static int64_t elapsed_us(const struct timespec *since, const struct timespec *now)
+{
+    return (now->tv_sec - since->tv_sec) * 1000000LL + (now->tv_nsec - since->tv_nsec) / 1000;
+}
+
+static void timespec_add_ms(struct timespec *t, long ms)
+{
+    t->tv_sec += ms / 1000;
+    t->tv_nsec += (ms % 1000) * 1000000L;
+    if (t->tv_nsec >= 1000000000L)
+    {
+        t->tv_sec++;
+        t->tv_nsec -= 1000000000L;
+    }
+}
+
+/* Build automaton matching all patterns, with failure transitions folded
+ * into the transition table so matching never has to backtrack */
+static void automaton_build(struct automaton_t *a, struct token_t *patterns, int count)
+{
+    int states = 1, size = 1;
+    int *fail, *queue;
+    int head = 0, tail = 0;
+    int i, s, t, c;
+    size_t j;
+
+    for (i = 0; i < count; i++)
+    {
+        size += patterns[i].length;
+    }
+
+    a->next = malloc(size * sizeof(*a->next));
+    a->match = malloc(size * sizeof(int));
+    fail = malloc(size * sizeof(int));
+    queue = malloc(size * sizeof(int));
+    if ((a->next == NULL) || (a->match == NULL) || (fail == NULL) || (queue == NULL))
+    {
+        tio_error_printf("Out of memory");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(a->next, -1, size * sizeof(*a->next));
+    memset(a->match, -1, size * sizeof(int));
+
+    /* Insert patterns into trie */
+    for (i = 0; i < count; i++)
+    {
+        s = 0;
+        for (j = 0; j < patterns[i].length; j++)
+        {
+            c = (unsigned char) patterns[i].text[j];
+            if (a->next[s][c] < 0)
+            {
+                a->next[s][c] = states++;
+            }
+            s = a->next[s][c];
+        }
+        if (a->match[s] < 0)
+        {
+            a->match[s] = i;
+        }
+    }
+
+    /* Complete transitions breadth first so failure states are done first */
+    fail[0] = 0;
+    queue[tail++] = 0;
+    while (head < tail)
+    {
+        s = queue[head++];
+        for (c = 0; c < 256; c++)
+        {
+            t = a->next[s][c];
+            if (t < 0)
+            {
+                a->next[s][c] = (s == 0) ? 0 : a->next[fail[s]][c];
+                continue;
+            }
+
+            fail[t] = (s == 0) ? 0 : a->next[fail[s]][c];
+            if (a->match[t] < 0)
+            {
+                a->match[t] = a->match[fail[t]];
+            }
+            queue[tail++] = t;
+        }
+    }
+
+    free(fail);
+    free(queue);
+}
+
+static void parse_error(int line, const char *message)
+{
+    tio_error_printf("%s:%d: %s", script_filename, line, message);
+    exit(EXIT_FAILURE);
+}
+
+/* Split line into tokens in place, unescaping quoted strings */
+static int tokenize(char *line, int number, struct token_t *tokens)
+{
+    char *p = line, *out;
+    int count = 0;
+    unsigned int value;
+
+    while (true)
+    {
+        while (isspace((unsigned char) *p))
+        {
+            p++;
+        }
+        if ((*p == 0) || (*p == '#'))
+        {
+            return count;
+        }
+        if (count == TOKENS_MAX)
+        {
+            parse_error(number, "Too many arguments");
+        }
+
+        if (*p != '"')
+        {
+            tokens[count].text = p;
+            tokens[count].quoted = false;
+            while ((*p != 0) && !isspace((unsigned char) *p))
+            {
+                p++;
+            }
+            tokens[count].length = p - tokens[count].text;
+            if (*p != 0)
+            {
+                *p++ = 0;
+            }
+            count++;
+            continue;
+        }
+
+        /* Unescape quoted string into itself */
+        tokens[count].text = out = ++p;
+        tokens[count].quoted = true;
+        while (*p != '"')
+        {
+            if (*p == 0)
+            {
+                parse_error(number, "Missing end quote");
+            }
+            if (*p != '\\')
+            {
+                *out++ = *p++;
+                continue;
+            }
+            switch (*++p)
+            {
+                case 'r': *out++ = '\r'; p++; break;
+                case 'n': *out++ = '\n'; p++; break;
+                case 't': *out++ = '\t'; p++; break;
+                case 'e': *out++ = 0x1b; p++; break;
+                case '\\': *out++ = '\\'; p++; break;
+                case '"': *out++ = '"'; p++; break;
+                case 'x':
+                    if (!isxdigit((unsigned char) p[1]) || !isxdigit((unsigned char) p[2]) ||
+                        (sscanf(p + 1, "%2x", &value) != 1))
+                    {
+                        parse_error(number, "Invalid hex escape");
+                    }
+                    *out++ = (char) value;
+                    p += 3;
+                    break;
+                default:
+                    parse_error(number, "Invalid escape");
+            }
+        }
+        tokens[count].length = out - tokens[count].text;
+        p++;
+        count++;
+    }
+}
+
+static long parse_number(struct token_t *token, int line)
+{
+    char *end;
+    long value;
+
+    errno = 0;
+    value = strtol(token->text, &end, 10);
+    if (token->quoted || (errno != 0) || (*end != 0) || (value < 0))
+    {
+        parse_error(line, "Invalid number");
+    }
+
+    return value;
+}
+
+/* Labels are resolved after loading, so store name for now */
+static char *label_reference(struct token_t *token, int line)
+{
+    if (token->quoted)
+    {
+        parse_error(line, "Invalid label");
+    }
+
+    return strdup(token->text);
+}
+
+static int label_resolve(char *name, int line)
+{
+    int i;
+
+    if (name == NULL)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < label_count; i++)
+    {
+        if (strcmp(labels[i].name, name) == 0)
+        {
+            free(name);
+            return labels[i].step;
+        }
+    }
+
+    parse_error(line, "Unknown label");
+    return -1;
+}
+
+static struct step_t *step_add(enum step_type_t type, int line)
+{
+    struct step_t *step;
+
+    steps = realloc(steps, (step_count + 1) * sizeof(struct step_t));
+    if (steps == NULL)
+    {
+        tio_error_printf("Out of memory");
+        exit(EXIT_FAILURE);
+    }
+
+    step = &steps[step_count++];
+    memset(step, 0, sizeof(struct step_t));
+    step->type = type;
+    step->line = line;
+    step->target = -1;
+
+    return step;
+}
+
+void script_load(const char *filename)
+{
+    struct token_t tokens[TOKENS_MAX];
+    struct token_t patterns[TOKENS_MAX];
+    struct step_t *step;
+    char *line = NULL;
+    size_t size = 0;
+    int number = 0;
+    int count, i;
+    FILE *file;
+
+    script_filename = filename;
+
+    file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        tio_error_printf("Could not open script file %s (%s)", filename, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    while (getline(&line, &size, file) >= 0)
+    {
+        number++;
+
+        count = tokenize(line, number, tokens);
+        if (count == 0)
+        {
+            continue;
+        }
+
+        /* Label */
+        if ((count == 1) && !tokens[0].quoted && (tokens[0].length > 1) &&
+            (tokens[0].text[tokens[0].length - 1] == ':'))
+        {
+            tokens[0].text[tokens[0].length - 1] = 0;
+            labels = realloc(labels, (label_count + 1) * sizeof(struct label_t));
+            if (labels == NULL)
+            {
+                tio_error_printf("Out of memory");
+                exit(EXIT_FAILURE);
+            }
+            labels[label_count].name = strdup(tokens[0].text);
+            labels[label_count].step = step_count;
+            label_count++;
+            continue;
+        }
+
+        if (strcmp(tokens[0].text, "send") == 0)
+        {
+            if ((count != 2) || !tokens[1].quoted)
+            {
+                parse_error(number, "Usage: send \"<string>\"");
+            }
+            step = step_add(STEP_SEND, number);
+            step->data = malloc(tokens[1].length + 1);
+            if (step->data == NULL)
+            {
+                tio_error_printf("Out of memory");
+                exit(EXIT_FAILURE);
+            }
+            memcpy(step->data, tokens[1].text, tokens[1].length);
+            step->length = tokens[1].length;
+        }
+        else if (strcmp(tokens[0].text, "expect") == 0)
+        {
+            step = step_add(STEP_EXPECT, number);
+            step->targets = malloc(count * sizeof(int));
+            step->target_labels = calloc(count, sizeof(char *));
+            if ((step->targets == NULL) || (step->target_labels == NULL))
+            {
+                tio_error_printf("Out of memory");
+                exit(EXIT_FAILURE);
+            }
+            for (i = 1; i < count; i++)
+            {
+                if (!tokens[i].quoted || (tokens[i].length == 0))
+                {
+                    parse_error(number, "Usage: expect \"<string>\" [<label>] ...");
+                }
+                patterns[step->patterns] = tokens[i];
+                if ((i + 1 < count) && !tokens[i + 1].quoted)
+                {
+                    step->target_labels[step->patterns] = label_reference(&tokens[++i], number);
+                }
+                step->patterns++;
+            }
+            if (step->patterns == 0)
+            {
+                parse_error(number, "Usage: expect \"<string>\" [<label>] ...");
+            }
+            automaton_build(&step->automaton, patterns, step->patterns);
+        }
+        else if (strcmp(tokens[0].text, "timeout") == 0)
+        {
+            if ((count < 2) || (count > 3))
+            {
+                parse_error(number, "Usage: timeout <ms> [<label>]");
+            }
+            step = step_add(STEP_TIMEOUT, number);
+            step->value = parse_number(&tokens[1], number);
+            step->target_label = (count == 3) ? label_reference(&tokens[2], number) : NULL;
+        }
+        else if (strcmp(tokens[0].text, "sleep") == 0)
+        {
+            if (count != 2)
+            {
+                parse_error(number, "Usage: sleep <ms>");
+            }
+            step = step_add(STEP_SLEEP, number);
+            step->value = parse_number(&tokens[1], number);
+        }
+        else if (strcmp(tokens[0].text, "goto") == 0)
+        {
+            if (count != 2)
+            {
+                parse_error(number, "Usage: goto <label>");
+            }
+            step = step_add(STEP_GOTO, number);
+            step->target_label = label_reference(&tokens[1], number);
+        }
+        else if (strcmp(tokens[0].text, "exit") == 0)
+        {
+            if (count != 2)
+            {
+                parse_error(number, "Usage: exit <status>");
+            }
+            step = step_add(STEP_EXIT, number);
+            step->value = parse_number(&tokens[1], number);
+        }
+        else
+        {
+            parse_error(number, "Unknown command");
+        }
+    }
+
+    free(line);
+    fclose(file);
+
+    /* Resolve labels */
+    for (i = 0; i < step_count; i++)
+    {
+        step = &steps[i];
+        switch (step->type)
+        {
+            case STEP_EXPECT:
+                for (count = 0; count < step->patterns; count++)
+                {
+                    step->targets[count] = label_resolve(step->target_labels[count], step->line);
+                }
+                free(step->target_labels);
+                step->target_labels = NULL;
+                break;
+
+            case STEP_TIMEOUT:
+            case STEP_GOTO:
+                step->target = label_resolve(step->target_label, step->line);
+                step->target_label = NULL;
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+static void step_timing(struct step_t *step, bool timed_out)
+{
+    struct timespec now;
+    int64_t elapsed;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = elapsed_us(&step_start, &now);
+
+    if (timed_out)
+    {
+        step->timeouts++;
+        return;
+    }
+
+    if ((step->matches == 0) || (elapsed < step->time_min))
+    {
+        step->time_min = elapsed;
+    }
+    if (elapsed > step->time_max)
+    {
+        step->time_max = elapsed;
+    }
+    step->time_total += elapsed;
+    step->matches++;
+}
+
+static void script_finish(const char *message, int line)
+{
+    active = false;
+    waiting = false;
+
+    if (line > 0)
+    {
+        tio_printf("Script %s at line %d", message, line);
+    }
+    else
+    {
+        tio_printf("Script %s", message);
+    }
+    script_print();
+}
+
+/* Start script from first step */
+void script_start(void)
+{
+    if (steps == NULL)
+    {
+        return;
+    }
+
+    active = true;
+    waiting = false;
+    matched = -1;
+    pending_count = 0;
+    current = 0;
+    timeout = DEFAULT_TIMEOUT;
+    timeout_target = -1;
+
+    tio_printf("Script %s started", script_filename);
+}
+
+void script_stop(void)
+{
+    if (active)
+    {
+        script_finish("stopped", (current < step_count) ? steps[current].line : 0);
+    }
+}
+
+bool script_active(void)
+{
+    return active;
+}
+
+/* Keep received data not matched yet for next expect step, dropping the oldest */
+static void pending_keep(const char *buffer, size_t count)
+{
+    if (count >= PENDING_MAX)
+    {
+        buffer += count - PENDING_MAX;
+        count = PENDING_MAX;
+    }
+    if (pending_count + count > PENDING_MAX)
+    {
+        size_t drop = pending_count + count - PENDING_MAX;
+        memmove(pending, pending + drop, pending_count - drop);
+        pending_count -= drop;
+    }
+    memcpy(pending + pending_count, buffer, count);
+    pending_count += count;
+}
+
+/* Match received data against strings of expect step being waited on */
+void script_input(const char *buffer, size_t count)
+{
+    struct automaton_t *a;
+    size_t i;
+
+    if (!active)
+    {
+        return;
+    }
+
+    if (!waiting || (steps[current].type != STEP_EXPECT) || (matched >= 0))
+    {
+        pending_keep(buffer, count);
+        return;
+    }
+
+    a = &steps[current].automaton;
+    for (i = 0; i < count; i++)
+    {
+        state = a->next[state][(unsigned char) buffer[i]];
+        if (a->match[state] >= 0)
+        {
+            matched = a->match[state];
+            pending_keep(buffer + i + 1, count - i - 1);
+            return;
+        }
+    }
+}
+
+static bool deadline_passed(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec > deadline.tv_sec) ||
+           ((now.tv_sec == deadline.tv_sec) && (now.tv_nsec >= deadline.tv_nsec));
+}
+
+/* Run script steps until waiting, returns exit status when script ends tio
+ * or -1 to continue */
+int script_run(int fd)
+{
+    char replay[PENDING_MAX];
+    size_t replay_count;
+    struct step_t *step;
+    int steps_run = 0;
+
+    while (active)
+    {
+        if (current >= step_count)
+        {
+            script_finish("finished", 0);
+            break;
+        }
+
+        /* Let the main loop handle input in case steps loop without waiting */
+        if (++steps_run > STEPS_PER_RUN)
+        {
+            return -1;
+        }
+
+        step = &steps[current];
+
+        switch (step->type)
+        {
+            case STEP_SEND:
+                forward_buffer_to_tty(fd, step->data, step->length);
+                current++;
+                break;
+
+            case STEP_EXPECT:
+                if (!waiting)
+                {
+                    waiting = true;
+                    state = 0;
+                    matched = -1;
+                    clock_gettime(CLOCK_MONOTONIC, &step_start);
+                    deadline = step_start;
+                    timespec_add_ms(&deadline, timeout);
+
+                    /* Data received after previous match may already hold the response */
+                    replay_count = pending_count;
+                    memcpy(replay, pending, replay_count);
+                    pending_count = 0;
+                    script_input(replay, replay_count);
+                }
+
+                if (matched >= 0)
+                {
+                    waiting = false;
+                    step_timing(step, false);
+                    current = (step->targets[matched] >= 0) ? step->targets[matched] : current + 1;
+                    break;
+                }
+
+                if ((timeout == 0) || !deadline_passed())
+                {
+                    return -1;
+                }
+
+                waiting = false;
+                step_timing(step, true);
+                if (timeout_target < 0)
+                {
+                    script_finish("timed out", step->line);
+                    return EXIT_FAILURE;
+                }
+                current = timeout_target;
+                break;
+
+            case STEP_TIMEOUT:
+                timeout = step->value;
+                timeout_target = step->target;
+                current++;
+                break;
+
+            case STEP_SLEEP:
+                if (!waiting)
+                {
+                    waiting = true;
+                    clock_gettime(CLOCK_MONOTONIC, &step_start);
+                    deadline = step_start;
+                    timespec_add_ms(&deadline, step->value);
+                }
+
+                if (!deadline_passed())
+                {
+                    return -1;
+                }
+
+                waiting = false;
+                current++;
+                break;
+
+            case STEP_GOTO:
+                current = step->target;
+                break;
+
+            case STEP_EXIT:
+                script_finish("exited", step->line);
+                return step->value;
+        }
+    }
+
+    return -1;
+}
+
+/* Return time in microseconds until script step times out, 0 if steps are
+ * left to run right away or -1 if not waiting */
+long script_timeout(void)
+{
+    struct timespec now;
+    int64_t remaining;
+
+    if (!active)
+    {
+        return -1;
+    }
+
+    if (!waiting)
+    {
+        return 0;
+    }
+
+    if ((steps[current].type == STEP_EXPECT) && (timeout == 0))
+    {
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    remaining = elapsed_us(&now, &deadline);
+
+    return (remaining > 0) ? remaining : 0;
+}
+
+void script_print(void)
+{
+    struct step_t *step;
+    int i;
+
+    for (i = 0; i < step_count; i++)
+    {
+        step = &steps[i];
+        if ((step->type != STEP_EXPECT) || ((step->matches == 0) && (step->timeouts == 0)))
+        {
+            continue;
+        }
+
+        if (step->matches == 0)
+        {
+            tio_printf(" Script line %d: %lu timeouts", step->line, step->timeouts);
+            continue;
+        }
+
+        tio_printf(" Script line %d: %lu matches, %lu timeouts, response min/avg/max %.3f/%.3f/%.3f ms",
+                   step->line, step->matches, step->timeouts, step->time_min / 1000.0,
+                   (double) step->time_total / step->matches / 1000.0, step->time_max / 1000.0);
+    }
+}
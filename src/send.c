@@ -0,0 +1,199 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Streaming file send
+ *
+ * The file is mapped into memory and handed to the tty output queue in
+ * chunks from the main loop whenever the queue has drained, so the device
+ * receives data as fast as it accepts it, honouring any flow control done
+ * by the driver, while received data and key commands keep being served.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+#include "send.h"
+#include "tty.h"
+#include "print.h"
+
+#define PROGRESS_INTERVAL 1000000   // us
+
+static const char *data = NULL;
+static size_t size = 0;
+static size_t offset = 0;
+static size_t pending = 0;
+static bool active = false;
+static struct timespec start;
+static struct timespec last_progress;
+
+static int64_t elapsed_us(const struct timespec *since, const struct timespec *now)
+{
+    return (now->tv_sec - since->tv_sec) * 1000000LL + (now->tv_nsec - since->tv_nsec) / 1000;
+}
+
+static void send_file_close(void)
+{
+    if ((data != NULL) && (size > 0))
+    {
+        munmap((void *) data, size);
+    }
+
+    data = NULL;
+    size = offset = pending = 0;
+    active = false;
+}
+
+/* Bytes accepted by the device, excluding those still in output queue */
+static size_t send_file_sent(void)
+{
+    return offset - MIN(pending, offset);
+}
+
+static void send_file_progress(const struct timespec *now)
+{
+    size_t sent = send_file_sent();
+    int64_t us = elapsed_us(&start, now);
+    long rate = (us > 0) ? (long) (sent * 1000000LL / us) : 0;
+    long eta = (rate > 0) ? (long) ((size - sent) / rate) : 0;
+    int percent = (size > 0) ? (int) (sent * 100 / size) : 100;
+
+    tio_printf("Sent %zu of %zu bytes (%d%%), %ld bytes/s, ETA %ld:%02ld",
+               sent, size, percent, rate, eta / 60, eta % 60);
+
+    last_progress = *now;
+}
+
+int send_file_start(const char *filename)
+{
+    struct stat st;
+    int file_fd;
+
+    if (active)
+    {
+        tio_warning_printf("File send already in progress");
+        return -1;
+    }
+
+    file_fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0)
+    {
+        tio_warning_printf("Could not open file %s (%s)", filename, strerror(errno));
+        return -1;
+    }
+
+    if ((fstat(file_fd, &st) < 0) || !S_ISREG(st.st_mode))
+    {
+        tio_warning_printf("Could not send %s (not a regular file)", filename);
+        close(file_fd);
+        return -1;
+    }
+
+    size = st.st_size;
+    if (size == 0)
+    {
+        tio_printf("File send concluded (%s is empty)", filename);
+        close(file_fd);
+        return 0;
+    }
+
+    data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file_fd, 0);
+    if (data == MAP_FAILED)
+    {
+        tio_warning_printf("Could not map file %s (%s)", filename, strerror(errno));
+        data = NULL;
+        size = 0;
+        close(file_fd);
+        return -1;
+    }
+    madvise((void *) data, size, MADV_SEQUENTIAL);
+    close(file_fd);
+
+    tio_printf("Sending file %s (%zu bytes), press ESC to abort", filename, size);
+
+    offset = 0;
+    active = true;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    last_progress = start;
+
+    return 0;
+}
+
+bool send_file_active(void)
+{
+    return active;
+}
+
+/* Hand up to room bytes of file to tty output, pending is output not yet
+ * accepted by the device */
+void send_file_process(int fd, size_t room, size_t queued)
+{
+    struct timespec now;
+    size_t count;
+
+    if (!active)
+    {
+        return;
+    }
+
+    pending = queued;
+
+    count = MIN(room, size - offset);
+    if (count > 0)
+    {
+        forward_buffer_to_tty(fd, data + offset, count);
+        offset += count;
+        pending += count;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if ((offset == size) && (pending == 0) && (count == 0))
+    {
+        int64_t us = elapsed_us(&start, &now);
+
+        tio_printf("File send concluded (%zu bytes in %lld.%01lld s, %ld bytes/s)", size,
+                   (long long) (us / 1000000), (long long) ((us / 100000) % 10),
+                   (us > 0) ? (long) (size * 1000000LL / us) : 0L);
+        send_file_close();
+    }
+    else if (elapsed_us(&last_progress, &now) >= PROGRESS_INTERVAL)
+    {
+        send_file_progress(&now);
+    }
+}
+
+void send_file_abort(void)
+{
+    if (active)
+    {
+        tio_warning_printf("File send aborted after %zu of %zu bytes", send_file_sent(), size);
+        send_file_close();
+    }
+}
@@ -0,0 +1,305 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Shared memory broadcast ring for local socket readers
+ *
+ * Received data is published into a memfd backed ring which readers map
+ * directly, so local readers cost no copy or system call per byte however
+ * many of them there are. The memfd is handed out with SCM_RIGHTS to anyone
+ * connecting to the unix socket next to the regular one (<socket>.shm). It is
+ * sealed against writing once mapped here, so readers can not corrupt it.
+ */
+
+#define _GNU_SOURCE
+
+#include "config.h"
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "shm.h"
+#include "options.h"
+#include "event.h"
+#include "print.h"
+
+#ifdef HAVE_MEMFD
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define SHM_DATA_OFFSET 4096
+
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+static struct shm_header_t *header = NULL;
+static char *data = NULL;
+static uint64_t size = 0;
+static int memfd = -1;
+static int listenfd = -1;
+static char path[PATH_MAX];
+static unsigned long readers = 0;
+static unsigned long wakeups = 0;
+
+static void shm_exit(void)
+{
+    unlink(path);
+}
+
+void shm_configure(const char *socket_filename)
+{
+    struct sockaddr_un addr = {};
+    size_t length;
+
+    /* Round size up to power of two so positions map to ring by masking */
+    size = 4096;
+    while (size < (uint64_t) option.socket_shm_size)
+    {
+        size <<= 1;
+    }
+    length = SHM_DATA_OFFSET + size;
+
+    memfd = memfd_create("tio", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0)
+    {
+        tio_error_printf("Failed to create shared memory (%s)", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    if (ftruncate(memfd, length) < 0)
+    {
+        tio_error_printf("Failed to size shared memory (%s)", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    header = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (header == MAP_FAILED)
+    {
+        tio_error_printf("Failed to map shared memory (%s)", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    /* Readers may trust the size of what they map and only map it read-only,
+     * while the mapping above stays writable */
+    if (fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) < 0)
+    {
+        tio_error_printf("Failed to seal shared memory (%s)", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    header->size = size;
+    header->offset = SHM_DATA_OFFSET;
+    header->version = SHM_VERSION;
+    __atomic_store_n(&header->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+    data = (char *) header + SHM_DATA_OFFSET;
+
+    /* Socket handing out the memfd */
+    snprintf(path, sizeof(path), "%s.shm", socket_filename);
+    if (strlen(path) > sizeof(addr.sun_path) - 1)
+    {
+        tio_error_printf("Socket file path %s too long", path);
+        exit(EXIT_FAILURE);
+    }
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    listenfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenfd < 0)
+    {
+        tio_error_printf("Failed to create socket (%s)", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    /* We own the regular socket, so any file left here is stale */
+    unlink(path);
+
+    if (bind(listenfd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+    {
+        tio_error_printf("Failed to bind to socket (%s)", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    if (listen(listenfd, SOMAXCONN) < 0)
+    {
+        tio_error_printf("Failed to listen on socket (%s)", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    atexit(shm_exit);
+
+    if (event_add(listenfd, EVENT_READ) < 0)
+    {
+        tio_error_printf("Failed to register socket (%s)", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    tio_printf("Sharing %lu bytes ring buffer on socket %s", (unsigned long) size, path);
+}
+
+bool shm_active(void)
+{
+    return (header != NULL);
+}
+
+/* Hand out memfd to new reader, returns true if fd was ours */
+bool shm_handle_input(int fd)
+{
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    struct msghdr msg = {};
+    struct cmsghdr *cmsg;
+    struct iovec iov;
+    char version = SHM_VERSION;
+    int clientfd;
+
+    if ((listenfd < 0) || (fd != listenfd))
+    {
+        return false;
+    }
+
+    clientfd = accept(listenfd, NULL, NULL);
+    if (clientfd < 0)
+    {
+        return true;
+    }
+
+    iov.iov_base = &version;
+    iov.iov_len = 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &memfd, sizeof(int));
+
+    if (sendmsg(clientfd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+    {
+        tio_error_printf_silent("Failed to hand out shared memory (%s)", strerror(errno));
+    }
+    else
+    {
+        readers++;
+    }
+
+    close(clientfd);
+
+    return true;
+}
+
+/* Publish data to readers */
+void shm_write(const char *buffer, size_t count)
+{
+    uint64_t head, position;
+    size_t length;
+
+    if ((header == NULL) || (count == 0))
+    {
+        return;
+    }
+
+    head = header->head;
+
+    /* Only the most recent bytes fit */
+    if (count > size)
+    {
+        head += count - size;
+        buffer += count - size;
+        count = size;
+    }
+
+    /* Announce what is about to be overwritten before touching the data, so
+     * a reader copying it meanwhile detects the overrun afterwards */
+    __atomic_store_n(&header->reserve, head + count, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    position = head & (size - 1);
+    length = (count < size - position) ? count : size - position;
+    memcpy(data + position, buffer, length);
+    memcpy(data, buffer + length, count - length);
+
+    __atomic_store_n(&header->head, head + count, __ATOMIC_RELEASE);
+
+    /* Readers can not announce that they wait, so wake them on every update
+     * once anyone has connected */
+    __atomic_add_fetch(&header->seq, 1, __ATOMIC_RELEASE);
+    if (readers > 0)
+    {
+        syscall(SYS_futex, &header->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+        wakeups++;
+    }
+}
+
+void shm_print(void)
+{
+    if (header == NULL)
+    {
+        return;
+    }
+
+    tio_printf(" Shared ring: %lu bytes published, %lu readers since start, %lu wake ups",
+               (unsigned long) header->head, readers, wakeups);
+}
+
+#else
+
+void shm_configure(const char *socket_filename)
+{
+    (void) socket_filename;
+
+    tio_error_printf("Shared memory ring not supported on this platform");
+    exit(EXIT_FAILURE);
+}
+
+bool shm_active(void)
+{
+    return false;
+}
+
+bool shm_handle_input(int fd)
+{
+    (void) fd;
+
+    return false;
+}
+
+void shm_write(const char *buffer, size_t count)
+{
+    (void) buffer;
+    (void) count;
+}
+
+void shm_print(void)
+{
+}
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Layout of the shared memory ring handed out to local readers
+ *
+ * Byte n of the received data is found at data[n % size] where data starts
+ * at offset from the beginning of the mapping. Before copying data in, the
+ * producer advances reserve to the end of what it is about to write, and
+ * once done advances head to the same value. A reader holding position pos
+ * may copy the bytes up to head. It must then reread reserve, and if
+ * reserve - pos exceeds size the bytes copied may have been overwritten
+ * meanwhile and the reader has been overrun.
+ *
+ * seq is bumped and FUTEX_WAKE called whenever head advances. A reader
+ * waiting for data reads seq, rereads head and, if nothing new arrived, does
+ * FUTEX_WAIT on seq. The memory is sealed against writes by readers, who
+ * can only map it read-only.
+ */
+
+#define SHM_MAGIC   0x72696f74      // "tior"
+#define SHM_VERSION 1
+
+struct shm_header_t
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;                  // Size of data area, power of two
+    uint64_t offset;                // Offset of data area
+    uint64_t head;                  // Number of bytes published
+    uint64_t reserve;               // Number of bytes published or being written
+    uint32_t seq;                   // Futex word
+    uint32_t padding;
+};
+
+void shm_configure(const char *socket_filename);
+bool shm_active(void);
+bool shm_handle_input(int fd);
+void shm_write(const char *buffer, size_t count);
+void shm_print(void);
@@ -0,0 +1,231 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Buffer kernels used by the RX path. Each kernel has a portable scalar
+ * implementation and, on x86, vectorized SSE2/AVX2 variants which are
+ * selected at runtime based on the features of the host CPU.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#define R2(n) n, n + 2*64, n + 1*64, n + 3*64
+#define R4(n) R2(n), R2(n + 2*16), R2(n + 1*16), R2(n + 3*16)
+#define R6(n) R4(n), R4(n + 2*4 ), R4(n + 1*4 ), R4(n + 3*4 )
+
+/* Bit reversed value of each byte */
+static const unsigned char reverse_table[256] =
+{
+    R6(0), R6(2), R6(1), R6(3)
+};
+
+static size_t find_eol_resolve(const char *buffer, size_t count);
+static void reverse_bits_resolve(char *buffer, size_t count);
+
+static size_t (*find_eol)(const char *buffer, size_t count) = find_eol_resolve;
+static void (*reverse_bits)(char *buffer, size_t count) = reverse_bits_resolve;
+
+static size_t find_eol_scalar(const char *buffer, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        if ((buffer[i] == '\n') || (buffer[i] == '\r'))
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+#ifdef HAVE_SIMD_X86
+__attribute__((target("sse2")))
+static size_t find_eol_sse2(const char *buffer, size_t count)
+{
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i data = _mm_loadu_si128((const __m128i *) (buffer + i));
+        __m128i match = _mm_or_si128(_mm_cmpeq_epi8(data, nl), _mm_cmpeq_epi8(data, cr));
+        unsigned int mask = _mm_movemask_epi8(match);
+
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + find_eol_scalar(buffer + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static size_t find_eol_avx2(const char *buffer, size_t count)
+{
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    size_t i = 0;
+
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i data = _mm256_loadu_si256((const __m256i *) (buffer + i));
+        __m256i match = _mm256_or_si256(_mm256_cmpeq_epi8(data, nl), _mm256_cmpeq_epi8(data, cr));
+        unsigned int mask = _mm256_movemask_epi8(match);
+
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + find_eol_sse2(buffer + i, count - i);
+}
+#endif
+
+static void reverse_bits_scalar(char *buffer, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        buffer[i] = reverse_table[(unsigned char) buffer[i]];
+    }
+}
+
+#ifdef HAVE_SIMD_X86
+/*
+ * Reverse bits by swapping the nibbles of each byte and looking up the
+ * bit reversed value of each nibble via shuffle.
+ */
+__attribute__((target("ssse3")))
+static void reverse_bits_ssse3(char *buffer, size_t count)
+{
+    const __m128i low_mask = _mm_set1_epi8(0x0f);
+    const __m128i low_table = _mm_setr_epi8(0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0,
+                                            0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0);
+    const __m128i high_table = _mm_setr_epi8(0x00, 0x08, 0x04, 0x0c, 0x02, 0x0a, 0x06, 0x0e,
+                                             0x01, 0x09, 0x05, 0x0d, 0x03, 0x0b, 0x07, 0x0f);
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i data = _mm_loadu_si128((const __m128i *) (buffer + i));
+        __m128i low = _mm_and_si128(data, low_mask);
+        __m128i high = _mm_and_si128(_mm_srli_epi16(data, 4), low_mask);
+
+        data = _mm_or_si128(_mm_shuffle_epi8(low_table, low), _mm_shuffle_epi8(high_table, high));
+        _mm_storeu_si128((__m128i *) (buffer + i), data);
+    }
+
+    reverse_bits_scalar(buffer + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void reverse_bits_avx2(char *buffer, size_t count)
+{
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    const __m256i low_table = _mm256_setr_epi8(0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0,
+                                               0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
+                                               0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0,
+                                               0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0);
+    const __m256i high_table = _mm256_setr_epi8(0x00, 0x08, 0x04, 0x0c, 0x02, 0x0a, 0x06, 0x0e,
+                                                0x01, 0x09, 0x05, 0x0d, 0x03, 0x0b, 0x07, 0x0f,
+                                                0x00, 0x08, 0x04, 0x0c, 0x02, 0x0a, 0x06, 0x0e,
+                                                0x01, 0x09, 0x05, 0x0d, 0x03, 0x0b, 0x07, 0x0f);
+    size_t i = 0;
+
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i data = _mm256_loadu_si256((const __m256i *) (buffer + i));
+        __m256i low = _mm256_and_si256(data, low_mask);
+        __m256i high = _mm256_and_si256(_mm256_srli_epi16(data, 4), low_mask);
+
+        data = _mm256_or_si256(_mm256_shuffle_epi8(low_table, low), _mm256_shuffle_epi8(high_table, high));
+        _mm256_storeu_si256((__m256i *) (buffer + i), data);
+    }
+
+    reverse_bits_ssse3(buffer + i, count - i);
+}
+#endif
+
+static void reverse_bits_resolve(char *buffer, size_t count)
+{
+    reverse_bits = reverse_bits_scalar;
+
+#ifdef HAVE_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        reverse_bits = reverse_bits_avx2;
+    }
+    else if (__builtin_cpu_supports("ssse3"))
+    {
+        reverse_bits = reverse_bits_ssse3;
+    }
+#endif
+
+    reverse_bits(buffer, count);
+}
+
+static size_t find_eol_resolve(const char *buffer, size_t count)
+{
+    find_eol = find_eol_scalar;
+
+#ifdef HAVE_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        find_eol = find_eol_avx2;
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        find_eol = find_eol_sse2;
+    }
+#endif
+
+    return find_eol(buffer, count);
+}
+
+/*
+ * Return index of first line boundary character (NL or CR) in buffer or
+ * count if there is none.
+ */
+size_t simd_find_eol(const char *buffer, size_t count)
+{
+    return find_eol(buffer, count);
+}
+
+/*
+ * Reverse bit order (MSB to LSB) of each byte in buffer.
+ */
+void simd_reverse_bits(char *buffer, size_t count)
+{
+    reverse_bits(buffer, count);
+}
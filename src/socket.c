@@ -25,23 +25,56 @@
 #include <stdlib.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <netinet/in.h>
 #include <unistd.h>
 #include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/param.h>
+#include <time.h>
+#include <sys/resource.h>
 
 #include "socket.h"
 #include "options.h"
 #include "print.h"
+#include "event.h"
+#include "ring.h"
+#include "shm.h"
 
-#define MAX_SOCKET_CLIENTS 16
 #define SOCKET_PORT_DEFAULT 3333
+#define SOCKET_BLOCK_TIMEOUT 1000 // ms
+
+struct socket_client_t
+{
+    int fd;
+    unsigned int id;            // Sequence number of connection
+    char peer[INET6_ADDRSTRLEN + 8];
+    struct timespec connected;
+    unsigned int events;        // Registered event types
+    struct ring_t queue;        // Output not yet accepted by client
+    unsigned long tx_bytes;     // Bytes sent to client
+    unsigned long rx_bytes;     // Bytes received from client
+    unsigned long dropped;      // Bytes dropped from full queue
+};
 
 static int sockfd;
-static int clientfds[MAX_SOCKET_CLIENTS];
+static struct socket_client_t *clients = NULL;  // Connected clients, packed
+static int numclients = 0;
+static int clients_allocated = 0;
+static int *client_index = NULL;                // Client by file descriptor or -1
+static int client_index_size = 0;
+static unsigned int clients_total = 0;
+static bool clients_enabled = false;
 static int socket_family = AF_UNSPEC;
 static int port_number = SOCKET_PORT_DEFAULT;
 
+static size_t queue_used(struct ring_t *queue)
+{
+    return queue->head - queue->tail;
+}
+
 static const char *socket_filename(void)
 {
     /* skip 'unix:' */
@@ -123,6 +156,7 @@ void socket_configure(void)
     struct sockaddr_in6 sockaddr_inet6 = {};
     struct sockaddr *sockaddr_p;
     socklen_t socklen;
+    struct rlimit limit;
 
     /* Parse socket string */
 
@@ -169,12 +203,30 @@ void socket_configure(void)
         }
     }
 
+    if (option.socket_max_clients < 1)
+    {
+        tio_error_printf("Invalid maximum number of socket clients: %d", option.socket_max_clients);
+        exit(EXIT_FAILURE);
+    }
+
     if (socket_family == AF_UNSPEC)
     {
         tio_error_printf("%s: Invalid socket scheme, must be prefixed with 'unix:', 'inet:', or 'inet6:'", option.socket);
         exit(EXIT_FAILURE);
     }
 
+    if ((option.socket_shm_size > 0) && (socket_family != AF_UNIX))
+    {
+        tio_error_printf("Shared ring requires a unix socket");
+        exit(EXIT_FAILURE);
+    }
+
+    if (option.socket_shm_size < 0)
+    {
+        tio_error_printf("Invalid shared ring size: %ld", option.socket_shm_size);
+        exit(EXIT_FAILURE);
+    }
+
     /* Configure socket */
 
     switch (socket_family)
@@ -216,6 +268,13 @@ void socket_configure(void)
             break;
     }
 
+    /* Make sure there are enough file descriptors for all clients */
+    if ((getrlimit(RLIMIT_NOFILE, &limit) == 0) && (limit.rlim_cur < (rlim_t) option.socket_max_clients + 64))
+    {
+        limit.rlim_cur = MIN(limit.rlim_max, (rlim_t) option.socket_max_clients + 64);
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
     /* Create socket */
     sockfd = socket(socket_family, SOCK_STREAM, 0);
     if (sockfd < 0)
@@ -232,18 +291,29 @@ void socket_configure(void)
     }
 
     /* Listen */
-    if (listen(sockfd, MAX_SOCKET_CLIENTS) < 0)
+    if (listen(sockfd, SOMAXCONN) < 0)
     {
         tio_error_printf("Failed to listen on socket (%s)", strerror(errno));
         exit(EXIT_FAILURE);
     }
 
-    memset(clientfds, -1, sizeof(clientfds));
     atexit(socket_exit);
 
+    /* Wait for clients */
+    if (event_add(sockfd, EVENT_READ) < 0)
+    {
+        tio_error_printf("Failed to register socket (%s)", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
     if (socket_family == AF_UNIX)
     {
         tio_printf("Listening on socket %s", socket_filename());
+
+        if (option.socket_shm_size > 0)
+        {
+            shm_configure(socket_filename());
+        }
     }
     else
     {
@@ -251,102 +321,612 @@ void socket_configure(void)
     }
 }
 
-void socket_write(char input_char)
+/* Register client for input while enabled and for output while queued */
+static void socket_client_events(struct socket_client_t *client)
 {
-    if (!option.socket)
+    unsigned int events = (clients_enabled ? EVENT_READ : 0) |
+                          ((queue_used(&client->queue) > 0) ? EVENT_WRITE : 0);
+
+    if (events == client->events)
     {
         return;
     }
 
-    for (int i = 0; i != MAX_SOCKET_CLIENTS; ++i)
+    if (client->events == 0)
     {
-        if (clientfds[i] != -1)
+        event_add(client->fd, events);
+    }
+    else if (events == 0)
+    {
+        event_remove(client->fd);
+    }
+    else
+    {
+        event_modify(client->fd, events);
+    }
+
+    client->events = events;
+}
+
+/* Add client to table, growing it as needed, returns NULL if out of memory */
+static struct socket_client_t *socket_client_add(int fd)
+{
+    struct socket_client_t *client;
+    int size;
+    int *index;
+
+    if (numclients == clients_allocated)
+    {
+        size = (clients_allocated > 0) ? (clients_allocated * 2) : 16;
+        client = realloc(clients, size * sizeof(struct socket_client_t));
+        if (client == NULL)
         {
-            if (write(clientfds[i], &input_char, 1) <= 0)
-            {
-                tio_error_printf_silent("Failed to write to socket (%s)", strerror(errno));
-                close(clientfds[i]);
-                clientfds[i] = -1;
-            }
+            return NULL;
         }
+        clients = client;
+        clients_allocated = size;
     }
+
+    if (fd >= client_index_size)
+    {
+        size = MAX(fd + 1, client_index_size * 2);
+        index = realloc(client_index, size * sizeof(int));
+        if (index == NULL)
+        {
+            return NULL;
+        }
+        for (int i = client_index_size; i < size; i++)
+        {
+            index[i] = -1;
+        }
+        client_index = index;
+        client_index_size = size;
+    }
+
+    client = &clients[numclients];
+    memset(client, 0, sizeof(struct socket_client_t));
+    client->fd = fd;
+    client->id = clients_total++;
+    clock_gettime(CLOCK_MONOTONIC, &client->connected);
+    client_index[fd] = numclients++;
+
+    return client;
 }
 
-int socket_add_fds(fd_set *rdfs, bool connected)
+/* Remove client from table by moving last client into its place */
+static void socket_client_close(struct socket_client_t *client)
 {
-    if (!option.socket)
+    int i = client - clients;
+
+    if (client->events != 0)
+    {
+        event_remove(client->fd);
+    }
+    close(client->fd);
+    ring_free(&client->queue);
+    client_index[client->fd] = -1;
+
+    if (i != --numclients)
+    {
+        clients[i] = clients[numclients];
+        client_index[clients[i].fd] = i;
+    }
+
+    /* Accept clients again when there is room */
+    if (numclients == option.socket_max_clients - 1)
+    {
+        event_add(sockfd, EVENT_READ);
+    }
+}
+
+static struct socket_client_t *socket_client_find(int fd)
+{
+    if ((fd < 0) || (fd >= client_index_size) || (client_index[fd] < 0))
+    {
+        return NULL;
+    }
+
+    return &clients[client_index[fd]];
+}
+
+/* Send queued output followed by buffer in a single call, returns number of
+ * bytes sent from buffer or -1 on error */
+static ssize_t socket_client_send(struct socket_client_t *client, const char *buffer, size_t count)
+{
+    struct ring_t *queue = &client->queue;
+    struct iovec iov[3];
+    struct msghdr msg = { .msg_iov = iov };
+    size_t used = queue_used(queue);
+    size_t length;
+    ssize_t status;
+    char *pointer;
+
+    /* Queued output may wrap around end of ring */
+    length = ring_read_space(queue, &pointer);
+    if (length > 0)
+    {
+        iov[msg.msg_iovlen].iov_base = pointer;
+        iov[msg.msg_iovlen++].iov_len = length;
+    }
+    if (length < used)
+    {
+        iov[msg.msg_iovlen].iov_base = queue->buffer;
+        iov[msg.msg_iovlen++].iov_len = used - length;
+    }
+    if (count > 0)
+    {
+        iov[msg.msg_iovlen].iov_base = (void *) buffer;
+        iov[msg.msg_iovlen++].iov_len = count;
+    }
+    if (msg.msg_iovlen == 0)
     {
         return 0;
     }
 
-    int numclients = 0, maxfd = 0;
-    for (int i = 0; i != MAX_SOCKET_CLIENTS; ++i)
+    do
+    {
+        status = sendmsg(client->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+    while ((status < 0) && (errno == EINTR));
+
+    if (status < 0)
+    {
+        return (errno == EAGAIN) ? 0 : -1;
+    }
+
+    client->tx_bytes += status;
+
+    if ((size_t) status <= used)
+    {
+        ring_release(queue, status);
+        return 0;
+    }
+
+    ring_release(queue, used);
+    return status - used;
+}
+
+/* Write queued output as far as client accepts it, returns -1 on error */
+static int socket_client_flush(struct socket_client_t *client)
+{
+    size_t used;
+
+    while ((used = queue_used(&client->queue)) > 0)
+    {
+        if (socket_client_send(client, NULL, 0) < 0)
+        {
+            return -1;
+        }
+        if (queue_used(&client->queue) == used)
+        {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/* Wait until client has accepted enough queued output to make room, giving
+ * up on client after SOCKET_BLOCK_TIMEOUT */
+static int socket_client_wait(struct socket_client_t *client, size_t room)
+{
+    struct pollfd pfd = { .fd = client->fd, .events = POLLOUT };
+    struct timespec start, now;
+    long remaining;
+    int status;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while ((client->queue.size - queue_used(&client->queue)) < room)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        remaining = SOCKET_BLOCK_TIMEOUT - ((now.tv_sec - start.tv_sec) * 1000 +
+                                            (now.tv_nsec - start.tv_nsec) / 1000000);
+        if (remaining <= 0)
+        {
+            tio_warning_printf("Disconnecting socket client which blocked output for too long");
+            errno = ETIMEDOUT;
+            return -1;
+        }
+
+        status = poll(&pfd, 1, (int) remaining);
+        if ((status < 0) && (errno != EINTR))
+        {
+            return -1;
+        }
+        if (status <= 0)
+        {
+            continue;
+        }
+        if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))
+        {
+            errno = EPIPE;
+            return -1;
+        }
+        if (socket_client_flush(client) < 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Add output to client queue, handling a full queue as configured, returns
+ * -1 if client is to be disconnected */
+static int socket_client_queue(struct socket_client_t *client, const char *buffer, size_t count)
+{
+    struct ring_t *queue = &client->queue;
+    size_t drop, length;
+    char *pointer;
+
+    if (queue_used(queue) + count > queue->size)
     {
-        if (clientfds[i] != -1)
+        switch (option.socket_slow_client)
         {
-            /* let clients block if they try to send while we're disconnected */
-            if (connected)
+            case SLOW_CLIENT_DROP:
+                /* Keep newest output, dropping oldest from queue first */
+                if (count > queue->size)
+                {
+                    drop = count - queue->size;
+                    client->dropped += drop;
+                    buffer += drop;
+                    count -= drop;
+                }
+                drop = queue_used(queue) + count - queue->size;
+                if (drop > 0)
+                {
+                    ring_release(queue, drop);
+                    client->dropped += drop;
+                }
+                break;
+
+            case SLOW_CLIENT_DISCONNECT:
+                tio_warning_printf("Disconnecting socket client which is not keeping up");
+                return -1;
+
+            case SLOW_CLIENT_BLOCK:
+                break;
+        }
+    }
+
+    while (count > 0)
+    {
+        length = ring_write_space(queue, &pointer);
+        if (length == 0)
+        {
+            /* Only happens when blocking on slow client */
+            if (socket_client_wait(client, MIN(count, queue->size / 2)) < 0)
             {
-                FD_SET(clientfds[i], rdfs);
-                maxfd = MAX(maxfd, clientfds[i]);
+                tio_error_printf_silent("Failed to write to socket (%s)", strerror(errno));
+                return -1;
             }
-            numclients++;
+            continue;
         }
+        length = MIN(length, count);
+        memcpy(pointer, buffer, length);
+        ring_commit(queue, length);
+        buffer += length;
+        count -= length;
+    }
+
+    return 0;
+}
+
+/* Send output after anything queued before it, queue what is left over */
+static void socket_client_write(struct socket_client_t *client, const char *buffer, size_t count)
+{
+    ssize_t status;
+
+    status = socket_client_send(client, buffer, count);
+    if (status < 0)
+    {
+        tio_error_printf_silent("Failed to write to socket (%s)", strerror(errno));
+        socket_client_close(client);
+        return;
     }
-    /* don't bother to accept clients if we're already full */
-    if (numclients != MAX_SOCKET_CLIENTS)
+    buffer += status;
+    count -= status;
+
+    if ((count > 0) && (socket_client_queue(client, buffer, count) < 0))
     {
-        FD_SET(sockfd, rdfs);
-        maxfd = MAX(maxfd, sockfd);
+        socket_client_close(client);
+        return;
     }
-    return maxfd;
+
+    socket_client_events(client);
 }
 
-bool socket_handle_input(fd_set *rdfs, char *output_char)
+void socket_write_buffer(const char *buffer, size_t count)
 {
+    if (!option.socket || (count == 0))
+    {
+        return;
+    }
+
+    shm_write(buffer, count);
+
+    /* Backwards as closing a client moves the last one into its place */
+    for (int i = numclients - 1; i >= 0; --i)
+    {
+        socket_client_write(&clients[i], buffer, count);
+    }
+}
+
+/* Write output to a single client */
+void socket_write_client(int fd, const char *buffer, size_t count)
+{
+    struct socket_client_t *client = socket_client_find(fd);
+
+    if ((client != NULL) && (count > 0))
+    {
+        socket_client_write(client, buffer, count);
+    }
+}
+
+/* Returns true if client has no output queued so it can be written directly */
+bool socket_client_idle(int fd)
+{
+    struct socket_client_t *client = socket_client_find(fd);
+
+    return (client != NULL) && (queue_used(&client->queue) == 0);
+}
+
+/* Account output written to client directly by caller */
+void socket_client_sent(int fd, size_t count)
+{
+    struct socket_client_t *client = socket_client_find(fd);
+
+    if (client != NULL)
+    {
+        client->tx_bytes += count;
+    }
+}
+
+int socket_client_count(void)
+{
+    return option.socket ? numclients : 0;
+}
+
+int socket_get_clientfds(int *fds, int max)
+{
+    int count = 0;
+
+    if (!option.socket)
+    {
+        return 0;
+    }
+
+    for (int i = 0; (i < numclients) && (count < max); ++i)
+    {
+        fds[count++] = clients[i].fd;
+    }
+
+    return count;
+}
+
+void socket_close_clientfd(int fd)
+{
+    struct socket_client_t *client = socket_client_find(fd);
+
+    if (client != NULL)
+    {
+        socket_client_close(client);
+    }
+}
+
+/* Let clients block if they try to send while we're disconnected */
+void socket_enable_clients(bool enable)
+{
+    if (!option.socket || (enable == clients_enabled))
+    {
+        return;
+    }
+
+    clients_enabled = enable;
+
+    for (int i = 0; i < numclients; ++i)
+    {
+        socket_client_events(&clients[i]);
+    }
+}
+
+/* Client accepts more queued output */
+void socket_handle_output(int fd)
+{
+    struct socket_client_t *client = socket_client_find(fd);
+
+    if (client == NULL)
+    {
+        return;
+    }
+
+    if (socket_client_flush(client) < 0)
+    {
+        tio_error_printf_silent("Failed to write to socket (%s)", strerror(errno));
+        socket_client_close(client);
+        return;
+    }
+
+    socket_client_events(client);
+}
+
+void socket_print(void)
+{
+    struct socket_client_t *client;
+    struct timespec now;
+
+    if (!option.socket)
+    {
+        return;
+    }
+
+    shm_print();
+
+    tio_printf(" Socket clients: %d connected (max %d), %u since start", numclients,
+               option.socket_max_clients, clients_total);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    for (int i = 0; i < numclients; ++i)
+    {
+        client = &clients[i];
+        tio_printf("  Client %u (%s, %ld s): sent %lu, received %lu, queued %zu (high water %zu of %zu), dropped %lu bytes",
+                   client->id, client->peer, (long) (now.tv_sec - client->connected.tv_sec),
+                   client->tx_bytes, client->rx_bytes, queue_used(&client->queue),
+                   client->queue.high_water, client->queue.size, client->dropped);
+    }
+}
+
+/* Describe client address */
+static void socket_peer_name(struct sockaddr_storage *addr, char *name, size_t size)
+{
+    char host[INET6_ADDRSTRLEN];
+
+    switch (addr->ss_family)
+    {
+        case AF_INET:
+            inet_ntop(AF_INET, &((struct sockaddr_in *) addr)->sin_addr, host, sizeof(host));
+            snprintf(name, size, "%s:%d", host, ntohs(((struct sockaddr_in *) addr)->sin_port));
+            break;
+
+        case AF_INET6:
+            inet_ntop(AF_INET6, &((struct sockaddr_in6 *) addr)->sin6_addr, host, sizeof(host));
+            snprintf(name, size, "[%s]:%d", host, ntohs(((struct sockaddr_in6 *) addr)->sin6_port));
+            break;
+
+        default:
+            snprintf(name, size, "local");
+            break;
+    }
+}
+
+/* Accept new client or read available input from client into buffer, returns
+ * number of bytes read */
+size_t socket_handle_input(int fd, char *buffer, size_t size)
+{
+    struct socket_client_t *client;
+    char *newline;
+    ssize_t status;
+
     if (!option.socket)
     {
-        return false;
+        return 0;
     }
 
-    if (FD_ISSET(sockfd, rdfs))
+    if (shm_handle_input(fd))
     {
-        int clientfd = accept(sockfd, NULL, NULL);
-        /* this loop should always succeed because we don't select on sockfd when full */
-        for (int i = 0; i != MAX_SOCKET_CLIENTS; ++i)
+        return 0;
+    }
+
+    if (fd == sockfd)
+    {
+        struct socket_client_t *client;
+        struct sockaddr_storage addr;
+        socklen_t addrlen = sizeof(addr);
+        struct ring_t queue;
+        int clientfd = accept(sockfd, (struct sockaddr *) &addr, &addrlen);
+        if (clientfd < 0)
         {
-            if (clientfds[i] == -1)
-            {
-                clientfds[i] = clientfd;
-                break;
-            }
+            return 0;
         }
+        /* Output to clients is queued so a slow client does not stall others */
+        if ((fcntl(clientfd, F_SETFL, O_NONBLOCK) < 0) ||
+            (ring_init(&queue, option.socket_queue_size) < 0))
+        {
+            tio_error_printf_silent("Failed to set up socket client (%s)", strerror(errno));
+            close(clientfd);
+            return 0;
+        }
+        client = socket_client_add(clientfd);
+        if (client == NULL)
+        {
+            tio_error_printf_silent("Failed to set up socket client (%s)", strerror(ENOMEM));
+            ring_free(&queue);
+            close(clientfd);
+            return 0;
+        }
+        client->queue = queue;
+        socket_peer_name(&addr, client->peer, sizeof(client->peer));
+        socket_client_events(client);
+
+        /* don't bother to accept clients if we're already full */
+        if (numclients == option.socket_max_clients)
+        {
+            event_remove(sockfd);
+        }
+        return 0;
+    }
+
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    client = socket_client_find(fd);
+    if (client == NULL)
+    {
+        return 0;
     }
-    for (int i = 0; i != MAX_SOCKET_CLIENTS; ++i)
+
+    /* Read at most one buffer per wakeup so all clients are served in turn */
+    status = read(client->fd, buffer, size);
+    if (status == 0)
     {
-        if (clientfds[i] != -1 && FD_ISSET(clientfds[i], rdfs))
+        socket_client_close(client);
+        return 0;
+    }
+    if (status < 0)
+    {
+        if ((errno == EAGAIN) || (errno == EINTR))
         {
-            int status = read(clientfds[i], output_char, 1);
-            if (status == 0)
-            {
-                close(clientfds[i]);
-                clientfds[i] = -1;
-                continue;
-            }
-            if (status < 0)
-            {
-                tio_error_printf_silent("Failed to read from socket (%s)", strerror(errno));
-                close(clientfds[i]);
-                clientfds[i] = -1;
-                continue;
-            }
-            /* match the behavior of a terminal in raw mode */
-            if (*output_char == '\n')
-            {
-                *output_char = '\r';
-            }
-            return true;
+            return 0;
         }
+        tio_error_printf_silent("Failed to read from socket (%s)", strerror(errno));
+        socket_client_close(client);
+        return 0;
     }
-    return false;
+    client->rx_bytes += status;
+
+    /* match the behavior of a terminal in raw mode */
+    for (newline = memchr(buffer, '\n', status); newline != NULL;
+         newline = memchr(newline + 1, '\n', status - (newline + 1 - buffer)))
+    {
+        *newline = '\r';
+    }
+    return status;
+}
+
+enum socket_slow_client_t socket_slow_client_option_parse(const char *arg)
+{
+    if (strcmp(arg, "drop") == 0)
+    {
+        return SLOW_CLIENT_DROP;
+    }
+    else if (strcmp(arg, "disconnect") == 0)
+    {
+        return SLOW_CLIENT_DISCONNECT;
+    }
+    else if (strcmp(arg, "block") == 0)
+    {
+        return SLOW_CLIENT_BLOCK;
+    }
+
+    tio_error_printf("Invalid slow client policy '%s'", arg);
+    exit(EXIT_FAILURE);
+}
+
+const char *socket_slow_client_to_string(enum socket_slow_client_t policy)
+{
+    switch (policy)
+    {
+        case SLOW_CLIENT_DROP:
+            return "drop";
+        case SLOW_CLIENT_DISCONNECT:
+            return "disconnect";
+        case SLOW_CLIENT_BLOCK:
+            return "block";
+    }
+
+    return "unknown";
 }
@@ -23,9 +23,26 @@
 #pragma once
 
 #include <stdbool.h>
-#include <sys/select.h>
+#include <stddef.h>
+
+enum socket_slow_client_t
+{
+    SLOW_CLIENT_DROP,
+    SLOW_CLIENT_DISCONNECT,
+    SLOW_CLIENT_BLOCK,
+};
 
 void socket_configure(void);
-void socket_write(char input_char);
-int socket_add_fds(fd_set *fds, bool connected);
-bool socket_handle_input(fd_set *fds, char *output_char);
+void socket_write_buffer(const char *buffer, size_t count);
+void socket_write_client(int fd, const char *buffer, size_t count);
+bool socket_client_idle(int fd);
+void socket_client_sent(int fd, size_t count);
+int socket_client_count(void);
+int socket_get_clientfds(int *fds, int max);
+void socket_close_clientfd(int fd);
+void socket_enable_clients(bool enable);
+size_t socket_handle_input(int fd, char *buffer, size_t size);
+void socket_handle_output(int fd);
+void socket_print(void);
+enum socket_slow_client_t socket_slow_client_option_parse(const char *arg);
+const char *socket_slow_client_to_string(enum socket_slow_client_t policy);
@@ -41,6 +41,7 @@
 #include <time.h>
 #include <dirent.h>
 #include <pthread.h>
+#include <poll.h>
 #include "config.h"
 #include "configfile.h"
 #include "tty.h"
@@ -56,6 +57,20 @@
 #include "timestamp.h"
 #include "misc.h"
 #include "extension.h"                      //by Evandro Souza
+#include "simd.h"
+#include "passthrough.h"
+#include "event.h"
+#include "uring.h"
+#include "ring.h"
+#include "icount.h"
+#include "pace.h"
+#include "send.h"
+#include "xymodem.h"
+#include "capture.h"
+#include "xonxoff.h"
+#include "cts.h"
+#include "script.h"
+#include "shm.h"
 
 #if defined(__APPLE__)
 #define PATH_SERIAL_DEVICES "/dev/"
@@ -72,18 +87,26 @@
 #define CMSPAR   010000000000
 #endif
 
+#define EVENTS_MAX 32
+#define RX_BACKLOG_MAX 65536  // Max ring data processed per event loop iteration
+#define TX_QUEUE_MIN (BUFSIZ*4)
+#define TX_QUEUE_HEADROOM (BUFSIZ*2)  // Room for one mapped stdin read
+
 #define KEY_0 0x30
 #define KEY_1 0x31
 #define KEY_2 0x32
 #define KEY_3 0x33
 #define KEY_4 0x34
 #define KEY_5 0x35
+#define KEY_6 0x36
 #define KEY_QUESTION 0x3F
 #define KEY_UPCASE_F 0x46                   //by Evandro Souza
 #define KEY_UPCASE_K 0x4B                   //by Evandro Souza
 #define KEY_UPCASE_L 0x4C                   //by Evandro Souza
+#define KEY_UPCASE_R 0x52
 #define KEY_UPCASE_S 0x53                   //by Evandro Souza
 #define KEY_UPCASE_U 0x55                   //by Evandro Souza
+#define KEY_UPCASE_X 0x58
 #define KEY_B 0x62
 #define KEY_C 0x63
 #define KEY_E 0x65
@@ -138,16 +161,42 @@ static bool map_i_nl_crnl = false;
 static bool map_o_del_bs = false;
 static bool map_o_ltu = false;
 static bool map_o_msblsb = false;
+static bool next_timestamp = false;
+static bool passthrough_supported = true;
+static enum line_mode_t command_line_mode = LINE_OFF;
+static char command_previous_char = 0;
+static bool command_transfer_mode = false;
+static bool transfer_receive = false;
+static enum xymodem_mode_t transfer_mode;
 static char hex_chars[2];
 static unsigned char hex_char_index = 0;
-static char tty_buffer[BUFSIZ*2];
-static size_t tty_buffer_count = 0;
-static char *tty_buffer_write_ptr = tty_buffer;
+static char *tx_queue = NULL;
+static size_t tx_queue_size = 0;
+static size_t tx_queue_start = 0;
+static size_t tx_queue_count = 0;
+static size_t tx_queue_high_water = 0;
+static unsigned long tx_throttle_count = 0;
+static bool input_throttled = false;
+static bool stdin_closed = false;
+static bool output_queue_supported = true;
+static bool soft_flow_control = false;
+static bool exit_pending = false;
+static int exit_status;
+static unsigned int tty_events = 0;
 static pthread_t thread;
 static int pipefd[2];
 static pthread_mutex_t mutex_input_ready = PTHREAD_MUTEX_INITIALIZER;
+static struct ring_t rx_ring;
+static pthread_t rx_thread;
+static int rx_pipefd[2] = { -1, -1 };
+static int rx_space_pipefd[2] = { -1, -1 };
+static bool rx_thread_running = false;
+static bool rx_full = false;
+static bool rx_failed = false;
+static bool rx_backlog = false;
 #if (ENABLE_PARALLEL_KEYBOARD == true)
 static bool show_parallel_keyboard;         //by Evandro Souza
+static char mount_string[16];               //by Evandro Souza. Updated by check_input_kb_event
 #endif  //#if (ENABLE_PARALLEL_KEYBOARD == true)
 
 static void optional_local_echo(char c)
@@ -163,6 +212,37 @@ static void optional_local_echo(char c)
     }
 }
 
+static void print_input_run(const char *buffer, size_t count)
+{
+    if (option.hex_mode)
+    {
+        if (option.hex_format == HEX_FORMAT_DUMP)
+        {
+            print_buffer_hexdump(buffer, count);
+        }
+        else
+        {
+            print_buffer_hex_write(buffer, count);
+        }
+    }
+    else
+    {
+        print_buffer_write(buffer, count);
+    }
+}
+
+inline static void print_input(char c)
+{
+    if (option.hex_mode)
+    {
+        print_input_run(&c, 1);
+    }
+    else
+    {
+        print_buffer_putc(c);
+    }
+}
+
 inline static bool is_valid_hex(char c)
 {
     return ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'));
@@ -188,32 +268,294 @@ inline static unsigned char char_to_nibble(char c)
     }
 }
 
+/* Update which tty device events the event loop listens for */
+static void tty_set_events(unsigned int events)
+{
+    if (events == tty_events)
+    {
+        return;
+    }
+
+    if (tty_events == 0)
+    {
+        event_add(fd, events);
+    }
+    else if (events == 0)
+    {
+        event_remove(fd);
+    }
+    else
+    {
+        event_modify(fd, events);
+    }
+
+    tty_events = events;
+}
+
+/* Pause reading stdin and socket input while the TX queue is full */
+static void tty_throttle_input(bool throttle)
+{
+    if (throttle == input_throttled)
+    {
+        return;
+    }
+
+    input_throttled = throttle;
+
+    if (throttle)
+    {
+        tx_throttle_count++;
+        tio_debug_printf("Output buffer full, pausing input");
+    }
+
+    if (!stdin_closed)
+    {
+        if (throttle)
+        {
+            event_remove(pipefd[0]);
+        }
+        else
+        {
+            event_add(pipefd[0], EVENT_READ);
+        }
+    }
+
+    socket_enable_clients(!throttle && connected);
+}
+
+static size_t tx_queue_limit(void)
+{
+    return MAX((size_t) option.output_buffer_size, TX_QUEUE_MIN);
+}
+
+/* Make room for up to count bytes at end of TX queue, returns contiguous space available */
+static size_t tx_queue_reserve(size_t count, size_t limit)
+{
+    size_t size;
+
+    /* Move queued data to front of buffer */
+    if ((tx_queue_start > 0) && ((tx_queue_start + tx_queue_count + count) > tx_queue_size))
+    {
+        memmove(tx_queue, tx_queue + tx_queue_start, tx_queue_count);
+        tx_queue_start = 0;
+    }
+
+    /* Grow buffer up to limit */
+    if (((tx_queue_count + count) > tx_queue_size) && (tx_queue_size < limit))
+    {
+        size = MAX(tx_queue_size, BUFSIZ);
+        while ((size < (tx_queue_count + count)) && (size < limit))
+        {
+            size *= 2;
+        }
+        size = MIN(size, limit);
+
+        char *queue = realloc(tx_queue, size);
+        if (queue != NULL)
+        {
+            tx_queue = queue;
+            tx_queue_size = size;
+        }
+    }
+
+    return MIN(count, tx_queue_size - tx_queue_start - tx_queue_count);
+}
+
+/* Return number of bytes queued in device driver, or -1 if not supported */
+static long tty_output_queued(int fd)
+{
+    int queued = -1;
+
+#ifdef TIOCOUTQ
+    if (ioctl(fd, TIOCOUTQ, &queued) == 0)
+    {
+        return queued;
+    }
+#endif
+
+    tio_warning_printf("Output queue depth not supported by device");
+    output_queue_supported = false;
+
+    return -1;
+}
+
+/* Returns true while output is paused by XOFF from device */
+static bool tty_xoff_paused(void)
+{
+    return soft_flow_control && xonxoff_paused();
+}
+
+/* Write as much queued output as the tty device accepts without blocking */
 void tty_sync(int fd)
 {
     ssize_t count;
+    size_t length;
+    long queued;
+    bool written = false;
+    bool paced = false;
+    bool held = tty_xoff_paused() || cts_blocked();
 
-    while (tty_buffer_count > 0)
+    while ((tx_queue_count > 0) && !held)
     {
-        count = write(fd, tty_buffer, tty_buffer_count);
+        length = tx_queue_count;
+
+        /* Release paced output one character at a time when due */
+        if (pace_enabled())
+        {
+            if (!pace_due())
+            {
+                paced = true;
+                break;
+            }
+            length = 1;
+        }
+        else if ((option.output_queue_depth > 0) && output_queue_supported)
+        {
+            /* Only hand device driver enough output to stay at target depth */
+            if (!pace_due())
+            {
+                paced = true;
+                break;
+            }
+
+            queued = tty_output_queued(fd);
+            if (queued >= option.output_queue_depth)
+            {
+                // Continue when driver queue has drained to half
+                pace_defer(queued - option.output_queue_depth / 2);
+                paced = true;
+                break;
+            }
+            else if (queued >= 0)
+            {
+                length = MIN(length, (size_t) (option.output_queue_depth - queued));
+            }
+        }
+
+        count = write(fd, tx_queue + tx_queue_start, length);
         if (count < 0)
         {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN)
+            {
+                break;
+            }
             // Error
             tio_debug_printf("Write error while flushing tty buffer (%s)", strerror(errno));
+            tx_queue_count = 0;
             break;
         }
-        tty_buffer_count -= count;
-        fsync(fd);
-        tcdrain(fd);
+        if (pace_enabled())
+        {
+            pace_next(tx_queue[tx_queue_start]);
+        }
+        tx_queue_start += count;
+        tx_queue_count -= count;
+        written = true;
+    }
+
+    if (held && (tx_queue_count > 0) && cts_blocked())
+    {
+        cts_hold();
+    }
+
+    if (tx_queue_count == 0)
+    {
+        tx_queue_start = 0;
+
+        /* Only wait for data to be transmitted when requested */
+        if (written && option.output_drain)
+        {
+            tcdrain(fd);
+        }
+    }
+
+    if (connected)
+    {
+        /* Continue when device becomes writable, paced output continues on
+         * timer and held output continues when XON is received or CTS goes high */
+        tty_set_events((tty_events & EVENT_READ) | (((tx_queue_count > 0) && !paced && !held) ? EVENT_WRITE : 0));
+
+        /* Throttle input sources until the queue has drained to half */
+        if ((tx_queue_limit() - tx_queue_count) < TX_QUEUE_HEADROOM)
+        {
+            tty_throttle_input(true);
+        }
+        else if (tx_queue_count <= (tx_queue_limit() / 2))
+        {
+            tty_throttle_input(false);
+        }
+    }
+}
+
+/* Top up TX queue from file being sent, leaving room for mapped output */
+static void tty_send_file_feed(void)
+{
+    size_t low = tx_queue_limit() / 2;
+
+    /* Keep going until output is left waiting for the device, as nothing
+     * else wakes up the event loop while the queue is empty */
+    while (send_file_active())
+    {
+        send_file_process(fd, (tx_queue_count < low) ? ((low - tx_queue_count) / 2) : 0, tx_queue_count);
+        tty_sync(fd);
+
+        if (tx_queue_count > 0)
+        {
+            break;
+        }
+    }
+}
+
+/* Write all queued output, waiting for the tty device as needed. Output
+ * paused by XOFF is left queued, as XON can only be received by the main
+ * loop, which resumes output via tty_sync() */
+static void tty_sync_wait(int fd)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+
+    tty_sync(fd);
+
+    while ((tx_queue_count > 0) && !tty_xoff_paused())
+    {
+        /* Sleep while paced or deferred output is not yet due */
+        if (cts_blocked())
+        {
+            cts_wait();
+        }
+        else if (!pace_due())
+        {
+            pace_sleep();
+        }
+        else
+        {
+            poll(&pfd, 1, -1);
+        }
+        tty_sync(fd);
+    }
+}
+
+/* Quit with status once queued output is written, in the main loop if
+ * output is paused by XOFF */
+static void tty_exit_when_drained(int status)
+{
+    tty_sync_wait(fd);
+
+    if (tx_queue_count == 0)
+    {
+        exit(status);
     }
 
-    // Reset
-    tty_buffer_write_ptr = tty_buffer;
-    tty_buffer_count = 0;
+    exit_pending = true;
+    exit_status = status;
 }
 
 ssize_t tty_write(int fd, const void *buffer, size_t count)
 {
-    ssize_t retval = 0, bytes_written = 0;
+    ssize_t bytes_written = 0;
     size_t i;
 
     if (map_o_ltu)
@@ -225,50 +567,491 @@ ssize_t tty_write(int fd, const void *buffer, size_t count)
         }
     }
 
-    if (option.output_delay || option.output_line_delay)
+    /* Output is queued and released by tty_sync(), paced if output delays are set */
+    while (count > 0)
     {
-        // Write byte by byte with output delay
-        for (i=0; i<count; i++)
+        // Wait for device if queue is full, input is throttled well before this happens
+        i = tx_queue_reserve(count, tx_queue_limit());
+        if ((i == 0) && tty_xoff_paused())
         {
-            retval = write(fd, buffer, 1);
-            if (retval < 0)
+            // Waiting for XON here would stall the main loop, so queue beyond limit
+            i = tx_queue_reserve(count, tx_queue_count + count);
+            if (i == 0)
             {
-                // Error
-                tio_debug_printf("Write error (%s)", strerror(errno));
+                tio_error_printf_silent("Failed to queue output while paused by XOFF");
                 break;
             }
-            bytes_written += retval;
+        }
+        if (i == 0)
+        {
+            tty_sync_wait(fd);
+            continue;
+        }
 
-            if (option.output_line_delay && *(unsigned char*)buffer == '\n')
+        // Copy bytes to TX queue
+        memcpy(tx_queue + tx_queue_start + tx_queue_count, buffer, i);
+        tx_queue_count += i;
+        bytes_written += i;
+        buffer = (const char *) buffer + i;
+        count -= i;
+    }
+
+    if (tx_queue_count > tx_queue_high_water)
+    {
+        tx_queue_high_water = tx_queue_count;
+    }
+
+    return bytes_written;
+}
+
+static void forward_input(const char *buffer, size_t count)
+{
+    /* Write to log */
+    if (option.log)
+    {
+        log_write(buffer, count);
+    }
+
+    print_tainted = true;
+}
+
+static void render_timestamp(void)
+{
+    char *now = timestamp_current_time();
+
+    if (now)
+    {
+        ansi_print_buffer_printf_raw("[%s] ", now);
+        if (option.log)
+        {
+            log_printf("[%s] ", now);
+        }
+        next_timestamp = false;
+    }
+}
+
+static void render_input(char *buffer, size_t count)
+{
+    size_t i = 0, length;
+    char input_char;
+
+    /* Convert MSB to LSB bit order */
+    if (map_o_msblsb)
+    {
+        simd_reverse_bits(buffer, count);
+    }
+
+    while (i < count)
+    {
+        /* Characters up to next line boundary need no special handling so
+         * they are passed on in bulk */
+        length = simd_find_eol(buffer + i, count - i);
+        if (length > 0)
+        {
+            /* Print timestamp on new line if enabled */
+            if (next_timestamp && !option.hex_mode)
             {
-                delay(option.output_line_delay);
+                render_timestamp();
             }
 
-            fsync(fd);
-            tcdrain(fd);
+            print_input_run(buffer + i, length);
+            forward_input(buffer + i, length);
+            i += length;
+            continue;
+        }
+
+        /* Handle line boundary character */
+        input_char = buffer[i];
+
+        /* Map input character */
+        if ((input_char == '\n') && (map_i_nl_crnl) && (!map_o_msblsb))
+        {
+            print_input('\r');
+            print_input('\n');
+        }
+        else
+        {
+            print_input(input_char);
+        }
+
+        forward_input(buffer + i, 1);
+        i++;
+
+        if (input_char == '\n' && option.timestamp)
+        {
+            next_timestamp = true;
+        }
+
+        if (option.response_wait)
+        {
+            socket_write_buffer(buffer, i);
+            uring_submit();
+            print_buffer_flush();
+            tty_sync_wait(fd);
+            exit(EXIT_SUCCESS);
+        }
+    }
+
+    /* Socket clients receive the chunk as is */
+    socket_write_buffer(buffer, count);
+}
+
+/* Stop or restart output already handed to the device driver when XOFF or
+ * XON is received, held back output in TX queue is released by tty_sync() */
+static void tty_flow_update(void)
+{
+    if (xonxoff_paused())
+    {
+        tcflow(fd, TCOOFF);
+    }
+    else
+    {
+        tcflow(fd, TCOON);
+        tty_sync(fd);
+    }
+}
+
+static void receive_input(char *buffer, size_t count)
+{
+    bool changed;
+
+    /* Update receive statistics */
+    rx_total += count;
+
+    /* Software flow control characters pause and resume output */
+    if (soft_flow_control)
+    {
+        count = xonxoff_filter(buffer, count, &changed);
+        if (changed)
+        {
+            tty_flow_update();
+        }
+        if (count == 0)
+        {
+            return;
+        }
+    }
+
+    /* Capture data as received */
+    capture_write(buffer, count);
+
+    /* Look for strings expected by script */
+    script_input(buffer, count);
+
+#if (ENABLE_PARALLEL_KEYBOARD == true)      // by Evandro Souza
+    // Start Display pressed keys from MSX Keyboard Emulator readings
+    if(show_parallel_keyboard)
+    {
+        /* Parse reception to show up on key maping */
+        for (size_t i=0; i<count; i++)
+        {
+            check_input_kb_event(buffer[i], mount_string);
+        }
+    }
+    else //if(show_parallel_keyboard)
+#endif  //#if (ENABLE_PARALLEL_KEYBOARD == true)
+    {
+        /* Render input chunk into output buffer */
+        render_input(buffer, count);
 
-            if (option.output_delay)
+        if (uring_enabled())
+        {
+            /* Submit output, log and socket writes of chunk at once */
+            if (print_buffer_flush_timeout() == 0)
             {
-                delay(option.output_delay);
+                print_buffer_queue();
             }
+            log_queue();
+            uring_submit();
         }
     }
-    else
+
+    /* Mark overruns in the output stream when counters are next polled */
+    icount_received();
+}
+
+static void rx_notify(void)
+{
+    char c = 0;
+
+    /* A full pipe means the main loop is already due to wake up */
+    write(rx_pipefd[1], &c, 1);
+}
+
+/* Wake up reader thread waiting for space in ring */
+static void rx_space_notify(void)
+{
+    char c = 0;
+
+    /* Pairs with the recheck in tty_rx_wait_space() so no wakeup is lost */
+    if (__atomic_load_n(&rx_full, __ATOMIC_SEQ_CST))
+    {
+        write(rx_space_pipefd[1], &c, 1);
+    }
+}
+
+/* Block reader thread until consumer has released space in ring */
+static void tty_rx_wait_space(void)
+{
+    struct pollfd pfd = { .fd = rx_space_pipefd[0], .events = POLLIN };
+    char buffer[64];
+    char *pointer;
+
+    __atomic_store_n(&rx_full, true, __ATOMIC_SEQ_CST);
+
+    /* Space may have been released before consumer could see flag */
+    if (ring_write_space(&rx_ring, &pointer) == 0)
+    {
+        poll(&pfd, 1, -1);
+    }
+
+    __atomic_store_n(&rx_full, false, __ATOMIC_SEQ_CST);
+    while (read(rx_space_pipefd[0], buffer, sizeof(buffer)) > 0);
+}
+
+/* Drain tty device into ring buffer so a slow consumer does not stall reads */
+static void *tty_rx_thread(void *arg)
+{
+    UNUSED(arg);
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    char *pointer;
+    size_t space;
+    ssize_t status;
+
+    while (true)
     {
-        // Force write of tty buffer if too full
-        if ((tty_buffer_count + count) > BUFSIZ)
+        space = ring_write_space(&rx_ring, &pointer);
+        if (space == 0)
         {
-            tty_sync(fd);
+            /* Ring full, wait for consumer to catch up */
+            tty_rx_wait_space();
+            continue;
+        }
+
+        if (poll(&pfd, 1, -1) < 0)
+        {
+            continue;
+        }
+
+        status = read(fd, pointer, space);
+        if ((status < 0) && ((errno == EAGAIN) || (errno == EINTR)))
+        {
+            continue;
+        }
+        if (status <= 0)
+        {
+            /* Error reading - device is likely unplugged */
+            __atomic_store_n(&rx_failed, true, __ATOMIC_RELEASE);
+            rx_notify();
+            break;
         }
 
-        // Copy bytes to tty write buffer
-        memcpy(tty_buffer_write_ptr, buffer, count);
-        tty_buffer_write_ptr += count;
-        tty_buffer_count += count;
-        bytes_written = count;
+        if (ring_commit(&rx_ring, status))
+        {
+            rx_notify();
+        }
     }
 
-    return bytes_written;
+    return NULL;
+}
+
+static void tty_rx_thread_start(void)
+{
+    if (rx_ring.buffer == NULL)
+    {
+        if (ring_init(&rx_ring, option.rx_buffer_size) < 0)
+        {
+            tio_error_printf("Could not allocate receive buffer");
+            exit(EXIT_FAILURE);
+        }
+
+        if ((pipe(rx_pipefd) == -1) ||
+            (fcntl(rx_pipefd[0], F_SETFL, O_NONBLOCK) == -1) ||
+            (fcntl(rx_pipefd[1], F_SETFL, O_NONBLOCK) == -1) ||
+            (pipe(rx_space_pipefd) == -1) ||
+            (fcntl(rx_space_pipefd[0], F_SETFL, O_NONBLOCK) == -1) ||
+            (fcntl(rx_space_pipefd[1], F_SETFL, O_NONBLOCK) == -1))
+        {
+            tio_error_printf("Failed to create pipe");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    rx_ring.head = rx_ring.tail = 0;
+    rx_full = false;
+    rx_failed = false;
+    rx_backlog = false;
+
+    if (pthread_create(&rx_thread, NULL, tty_rx_thread, NULL) != 0)
+    {
+        tio_error_printf("pthread_create() error");
+        exit(EXIT_FAILURE);
+    }
+    rx_thread_running = true;
+
+    if (event_add(rx_pipefd[0], EVENT_READ) < 0)
+    {
+        tio_error_printf("Could not register receive pipe (%s)", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void tty_rx_thread_stop(void)
+{
+    char buffer[64];
+
+    if (!rx_thread_running)
+    {
+        return;
+    }
+
+    /* Reader thread only blocks in poll() and read() which are cancellation points */
+    pthread_cancel(rx_thread);
+    pthread_join(rx_thread, NULL);
+    rx_thread_running = false;
+
+    event_remove(rx_pipefd[0]);
+    while (read(rx_pipefd[0], buffer, sizeof(buffer)) > 0);
+    while (read(rx_space_pipefd[0], buffer, sizeof(buffer)) > 0);
+}
+
+/* Process data collected by reader thread, returns -1 if reader failed */
+static int tty_rx_process(void)
+{
+    char buffer[64];
+    char *pointer;
+    size_t count, total = 0;
+
+    /* Clear notifications before looking at the ring so none get lost */
+    while (read(rx_pipefd[0], buffer, sizeof(buffer)) > 0);
+
+    while ((total < RX_BACKLOG_MAX) && ((count = ring_read_space(&rx_ring, &pointer)) > 0))
+    {
+        receive_input(pointer, count);
+        ring_release(&rx_ring, count);
+        rx_space_notify();
+        total += count;
+    }
+
+    /* Come back after serving other event sources if data remains */
+    rx_backlog = (ring_read_space(&rx_ring, &pointer) > 0);
+
+    if (!rx_backlog && __atomic_load_n(&rx_failed, __ATOMIC_ACQUIRE))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void print_statistics(void)
+{
+    tio_printf("Statistics:");
+    tio_printf(" Sent %lu bytes", tx_total);
+    tio_printf(" Received %lu bytes", rx_total);
+    if (option.rx_buffer_size > 0)
+    {
+        tio_printf(" Receive buffer high water: %zu of %zu bytes", rx_ring.high_water, rx_ring.size);
+    }
+    tio_printf(" Output buffer high water: %zu of %zu bytes", tx_queue_high_water, tx_queue_limit());
+    tio_printf(" Input paused %lu times due to full output buffer", tx_throttle_count);
+    capture_print();
+    if (soft_flow_control)
+    {
+        xonxoff_print();
+    }
+    cts_print();
+    script_print();
+    socket_print();
+    if (connected)
+    {
+        icount_poll(fd);
+        icount_print();
+    }
+}
+
+/* Return time in microseconds until statistics are due to be printed, or -1 if disabled */
+static long statistics_timeout(void)
+{
+    static struct timespec next;
+    struct timespec now;
+    long remaining;
+
+    if (option.stats_interval <= 0)
+    {
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (next.tv_sec == 0)
+    {
+        next.tv_sec = now.tv_sec + option.stats_interval;
+        next.tv_nsec = now.tv_nsec;
+    }
+
+    remaining = (next.tv_sec - now.tv_sec) * 1000000L + (next.tv_nsec - now.tv_nsec) / 1000;
+    if (remaining <= 0)
+    {
+        print_statistics();
+        next.tv_sec += option.stats_interval;
+        remaining += option.stats_interval * 1000000L;
+        if (remaining <= 0)
+        {
+            // Skip intervals missed while busy
+            next.tv_sec = now.tv_sec + option.stats_interval;
+            next.tv_nsec = now.tv_nsec;
+            remaining = option.stats_interval * 1000000L;
+        }
+    }
+
+    return remaining;
+}
+
+/* Stdin input can be forwarded in bulk while no key command is in progress */
+static bool tty_bulk_input_possible(void)
+{
+    /* Hex input is parsed and input during file send checked character by character */
+    if (option.hex_mode || send_file_active())
+    {
+        return false;
+    }
+
+    if (!interactive_mode)
+    {
+        return true;
+    }
+
+#if (ENABLE_PARALLEL_KEYBOARD == true)
+    if (show_parallel_keyboard)
+    {
+        return false;
+    }
+#endif
+
+    return (command_line_mode == LINE_OFF) && !command_transfer_mode && (command_previous_char != option.prefix_code);
+}
+
+/* Received data can bypass rendering when no transformation is active */
+static bool passthrough_possible(void)
+{
+#if (ENABLE_PARALLEL_KEYBOARD == true)
+    if (show_parallel_keyboard)
+    {
+        return false;
+    }
+#endif
+    return passthrough_supported &&
+           !option.hex_mode &&
+           (option.timestamp == TIMESTAMP_NONE) &&
+           !map_i_nl_crnl &&
+           !map_o_msblsb &&
+           !option.response_wait &&
+           !capture_active() &&
+           !script_active() &&
+           !shm_active() &&
+           !soft_flow_control &&
+           !(option.log && option.log_strip);
 }
 
 void *tty_stdin_input_thread(void *arg)
@@ -368,12 +1151,21 @@ void tty_input_thread_create(void)
 void tty_input_thread_wait_ready(void)
 {
     pthread_mutex_lock(&mutex_input_ready);
+
+    /* Listen for input from stdin thread */
+    if (event_add(pipefd[0], EVENT_READ) < 0)
+    {
+        tio_error_printf("Could not register stdin pipe (%s)", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
 }
 
 static void output_hex(char c)
 {
     hex_chars[hex_char_index++] = c;
 
+    print_buffer_flush();
+
     printf("%c", c);
 
     if (hex_char_index == 2)
@@ -463,13 +1255,89 @@ static void toggle_line(const char *line_name, int mask, enum line_mode_t line_m
     }
 }
 
+/* Run file transfer, taking over tty device until done */
+static int tty_transfer_file(bool receive, enum xymodem_mode_t mode, const char *filename)
+{
+    bool rx_thread = rx_thread_running;
+    int abort_fd = interactive_mode ? pipefd[0] : -1;
+    int status;
+
+    /* Send pending output and stop reader thread so protocol gets all input */
+    tty_sync_wait(fd);
+    if (rx_thread)
+    {
+        tty_rx_thread_stop();
+        tty_rx_process();
+    }
+    print_buffer_flush();
+
+    if (receive)
+    {
+        status = xymodem_receive(fd, abort_fd, filename, mode);
+    }
+    else
+    {
+        status = xymodem_send(fd, abort_fd, filename, mode);
+    }
+
+    if (rx_thread)
+    {
+        tty_rx_thread_start();
+    }
+
+    return status;
+}
+
+static void tty_transfer_file_entered(const char *filename)
+{
+    tty_transfer_file(transfer_receive, transfer_mode, filename);
+}
+
+static void tty_capture_file_entered(const char *filename)
+{
+    capture_start(filename);
+}
+
+static void handle_transfer_selection(char input_char)
+{
+    switch (input_char)
+    {
+        case KEY_0:
+        case KEY_1:
+        case KEY_2:
+            transfer_receive = false;
+            transfer_mode = (input_char == KEY_0) ? XMODEM_CRC : (input_char == KEY_1) ? XMODEM_1K : YMODEM;
+            filename_request("Enter file name to send: ", tty_transfer_file_entered);
+            break;
+        case KEY_3:
+            transfer_receive = true;
+            transfer_mode = XMODEM_CRC;
+            filename_request("Enter file name to receive: ", tty_transfer_file_entered);
+            break;
+        case KEY_4:
+            // YMODEM receives files under the names sent
+            tty_transfer_file(true, YMODEM, ".");
+            break;
+        case KEY_5:
+            transfer_receive = false;
+            transfer_mode = ZMODEM;
+            filename_request("Enter file name to send: ", tty_transfer_file_entered);
+            break;
+        case KEY_6:
+            // ZMODEM receives files under the names sent
+            tty_transfer_file(true, ZMODEM, ".");
+            break;
+        default:
+            tio_warning_printf("Invalid file transfer");
+            break;
+    }
+}
+
 void handle_command_sequence(char input_char, char *output_char, bool *forward)
 {
     char unused_char;
     bool unused_bool;
     int state;
-    static enum line_mode_t line_mode = LINE_OFF;
-    static char previous_char = 0;
 
     /* Ignore unused arguments */
     if (output_char == NULL)
@@ -482,42 +1350,51 @@ void handle_command_sequence(char input_char, char *output_char, bool *forward)
         forward = &unused_bool;
     }
 
-    if (line_mode)
+    if (command_line_mode)
     {
         // Handle line toggle number action
         *forward = false;
         switch (input_char)
         {
             case KEY_0:
-                toggle_line("DTR", TIOCM_DTR, line_mode);
+                toggle_line("DTR", TIOCM_DTR, command_line_mode);
                 break;
             case KEY_1:
-                toggle_line("RTS", TIOCM_RTS, line_mode);
+                toggle_line("RTS", TIOCM_RTS, command_line_mode);
                 break;
             case KEY_2:
-                toggle_line("CTS", TIOCM_CTS, line_mode);
+                toggle_line("CTS", TIOCM_CTS, command_line_mode);
                 break;
             case KEY_3:
-                toggle_line("DSR", TIOCM_DSR, line_mode);
+                toggle_line("DSR", TIOCM_DSR, command_line_mode);
                 break;
             case KEY_4:
-                toggle_line("DCD", TIOCM_CD, line_mode);
+                toggle_line("DCD", TIOCM_CD, command_line_mode);
                 break;
             case KEY_5:
-                toggle_line("RI", TIOCM_RI, line_mode);
+                toggle_line("RI", TIOCM_RI, command_line_mode);
                 break;
             default:
                 tio_warning_printf("Invalid line number");
                 break;
         }
 
-        line_mode = LINE_OFF;
+        command_line_mode = LINE_OFF;
 
         return;
     }
 
+    if (command_transfer_mode)
+    {
+        // Handle file transfer number action
+        *forward = false;
+        command_transfer_mode = false;
+        handle_transfer_selection(input_char);
+        return;
+    }
+
     /* Handle escape key commands */
-    if (previous_char == option.prefix_code)
+    if (command_previous_char == option.prefix_code)
     {
         /* Do not forward input char to output by default */
         *forward = false;
@@ -528,7 +1405,7 @@ void handle_command_sequence(char input_char, char *output_char, bool *forward)
             /* Forward prefix character to tty */
             *output_char = option.prefix_code;
             *forward = true;
-            previous_char = 0;
+            command_previous_char = 0;
             return;
         }
 
@@ -549,10 +1426,12 @@ void handle_command_sequence(char input_char, char *output_char, bool *forward)
                 tio_printf(" ctrl-%c m       Toggle MSB to LSB bit order", option.prefix_key);
                 tio_printf(" ctrl-%c p       Pulse serial port line", option.prefix_key);
                 tio_printf(" ctrl-%c q       Quit", option.prefix_key);
+                tio_printf(" ctrl-%c R       Start or stop capture of received data", option.prefix_key);
                 tio_printf(" ctrl-%c s       Show statistics", option.prefix_key);
                 tio_printf(" ctrl-%c t       Toggle line timestamp mode", option.prefix_key);
                 tio_printf(" ctrl-%c U       Toggle conversion to uppercase on output", option.prefix_key);
                 tio_printf(" ctrl-%c v       Show version", option.prefix_key);
+                tio_printf(" ctrl-%c X       Send or receive file via XMODEM/YMODEM/ZMODEM", option.prefix_key);
 #if (ENABLE_SEND_FILE == true)              //by Evandro Souza
                 tio_printf(" ctrl-%c S       Send ASCII file", option.prefix_key);
 #endif
@@ -605,7 +1484,7 @@ void handle_command_sequence(char input_char, char *output_char, bool *forward)
                 tio_printf(" DCD (4)");
                 tio_printf(" RI  (5)");
                 // Process next input character as part of the line toggle step
-                line_mode = LINE_TOGGLE;
+                command_line_mode = LINE_TOGGLE;
                 break;
 
             case KEY_P:
@@ -617,7 +1496,7 @@ void handle_command_sequence(char input_char, char *output_char, bool *forward)
                 tio_printf(" DCD (4)");
                 tio_printf(" RI  (5)");
                 // Process next input character as part of the line pulse step
-                line_mode = LINE_PULSE;
+                command_line_mode = LINE_PULSE;
                 break;
 
             case KEY_B:
@@ -649,6 +1528,9 @@ void handle_command_sequence(char input_char, char *output_char, bool *forward)
                 }
                 else
                 {
+                    /* Complete any pending hexdump row */
+                    print_hexdump_end();
+                    print_buffer_flush();
                     print = print_normal;
                     option.hex_mode = false;
                     tio_printf("Switched to normal mode");
@@ -657,7 +1539,7 @@ void handle_command_sequence(char input_char, char *output_char, bool *forward)
 
             case KEY_L:
                 /* Clear screen using ANSI/VT100 escape code */
-                printf("\033c");
+                print_buffer_write("\033c", 2);
                 break;
 
             case KEY_M:
@@ -680,9 +1562,7 @@ void handle_command_sequence(char input_char, char *output_char, bool *forward)
 
             case KEY_S:
                 /* Show tx/rx statistics upon ctrl-t s sequence */
-                tio_printf("Statistics:");
-                tio_printf(" Sent %lu bytes", tx_total);
-                tio_printf(" Received %lu bytes", rx_total);
+                print_statistics();
                 break;
 
             case KEY_T:
@@ -734,6 +1614,30 @@ void handle_command_sequence(char input_char, char *output_char, bool *forward)
             break;
 #endif  //#if (ENABLE_PARALLEL_KEYBOARD == true)
 
+            case KEY_UPCASE_R:
+                if (capture_active())
+                {
+                    capture_stop();
+                }
+                else
+                {
+                    filename_request("Enter file name to capture to: ", tty_capture_file_entered);
+                }
+                break;
+
+            case KEY_UPCASE_X:
+                tio_printf("Please enter which file transfer to start:");
+                tio_printf(" Send via XMODEM (0)");
+                tio_printf(" Send via XMODEM-1K (1)");
+                tio_printf(" Send via YMODEM (2)");
+                tio_printf(" Receive via XMODEM (3)");
+                tio_printf(" Receive via YMODEM (4)");
+                tio_printf(" Send via ZMODEM (5)");
+                tio_printf(" Receive via ZMODEM (6)");
+                // Process next input character as part of the file transfer step
+                command_transfer_mode = true;
+                break;
+
 #if (ENABLE_SEND_FILE == true)              //by Evandro Souza
             case KEY_UPCASE_S:
                 file_send();
@@ -744,9 +1648,9 @@ void handle_command_sequence(char input_char, char *output_char, bool *forward)
                 /* Ignore unknown ctrl-t escaped keys */
                 break;
         }   //switch (input_char)
-    }   //if (previous_char == option.prefix_code)
+    }   //if (command_previous_char == option.prefix_code)
 
-    previous_char = input_char;
+    command_previous_char = input_char;
 }
 
 void stdin_restore(void)
@@ -796,8 +1700,10 @@ void stdout_configure(void)
 {
     int status;
 
-    /* Disable line buffering in stdout. This is necessary if we
-     * want things like local echo to work correctly. */
+    /* Disable line buffering in stdout so that tio text is printed
+     * immediately. Received data and local echo do not go through stdio but
+     * are collected in the print buffer which is flushed when idle or when
+     * the flush latency expires. */
     setvbuf(stdout, NULL, _IONBF, 0);
 
     /* Save current stdout settings */
@@ -922,8 +1828,10 @@ void tty_configure(void)
     }
     else if (strcmp("soft", option.flow) == 0)
     {
+        /* Output is paused by tio itself so all output sources obey XOFF */
         tio.c_cflag &= ~CRTSCTS;
-        tio.c_iflag |= IXON | IXOFF;
+        tio.c_iflag &= ~(IXON | IXANY);
+        tio.c_iflag |= IXOFF;
     }
     else if (strcmp("none", option.flow) == 0)
     {
@@ -1059,10 +1967,9 @@ void tty_configure(void)
 
 void tty_wait_for_device(void)
 {
-    fd_set rdfs;
+    struct event_t events[EVENTS_MAX];
     int    status;
-    int    maxfd;
-    struct timeval tv;
+    long   timeout;
     static char input_char;
     static bool first = true;
     static int last_errno = 0;
@@ -1077,46 +1984,65 @@ void tty_wait_for_device(void)
             if (first)
             {
                 /* Don't wait first time */
-                tv.tv_sec = 0;
-                tv.tv_usec = 1;
+                timeout = 0;
                 first = false;
             }
             else
             {
                 /* Wait up to 1 second for input */
-                tv.tv_sec = 1;
-                tv.tv_usec = 0;
+                timeout = 1000000;
             }
 
-            FD_ZERO(&rdfs);
-            FD_SET(pipefd[0], &rdfs);
-            maxfd = MAX(pipefd[0], socket_add_fds(&rdfs, false));
+            /* Flush pending output before going idle */
+            print_buffer_flush();
 
             /* Block until input becomes available or timeout */
-            status = select(maxfd + 1, &rdfs, NULL, NULL, &tv);
-            if (status > 0)
+            status = event_wait(events, EVENTS_MAX, timeout);
+            if ((status == -1) && (errno == EINTR))
             {
-                if (FD_ISSET(pipefd[0], &rdfs))
+                // Interrupted by io_uring completion work
+                continue;
+            }
+            else if (status == -1)
+            {
+                tio_error_printf("Waiting for events failed (%s)", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+
+            for (int i = 0; i < status; i++)
+            {
+                if (events[i].fd == uring_fd())
+                {
+                    /* Output submitted via io_uring completed */
+                    uring_reap();
+                }
+                else if (events[i].fd == pipefd[0])
                 {
                     /* Input from stdin ready */
 
                     /* Read one character */
-                    status = read(pipefd[0], &input_char, 1);
-                    if (status <= 0)
+                    if (read(pipefd[0], &input_char, 1) <= 0)
                     {
                         tio_error_printf("Could not read from stdin");
                         exit(EXIT_FAILURE);
                     }
-
-                    /* Handle commands */
-                    handle_command_sequence(input_char, NULL, NULL);
+
+                    /* Handle commands */
+                    handle_command_sequence(input_char, NULL, NULL);
+                }
+                else
+                {
+                    /* Clients are not served while disconnected, only
+                     * accepted and sent output still queued for them */
+                    if (events[i].events & EVENT_WRITE)
+                    {
+                        socket_handle_output(events[i].fd);
+                    }
+                    if (events[i].events & EVENT_READ)
+                    {
+                        socket_handle_input(events[i].fd, NULL, 0);
+                    }
                 }
-                socket_handle_input(&rdfs, NULL);
-            }
-            else if (status == -1)
-            {
-                tio_error_printf("select() failed (%s)", strerror(errno));
-                exit(EXIT_FAILURE);
             }
         }
 
@@ -1148,7 +2074,25 @@ void tty_disconnect(void)
 {
     if (connected)
     {
+        print_hexdump_end();
+        print_buffer_flush();
         tio_printf("Disconnected");
+        tty_rx_thread_stop();
+        cts_stop();
+
+        /* Drop output which can no longer be sent */
+        send_file_abort();
+        script_stop();
+        tx_queue_start = tx_queue_count = 0;
+        if (exit_pending)
+        {
+            exit(exit_status);
+        }
+        pace_reset();
+        tty_throttle_input(false);
+        tty_set_events(0);
+
+        socket_enable_clients(false);
         flock(fd, LOCK_UN);
         close(fd);
         connected = false;
@@ -1174,73 +2118,108 @@ void tty_restore(void)
     }
 }
 
-void forward_to_tty(int fd, char output_char)
+/* Map and send a block of output characters */
+void forward_buffer_to_tty(int fd, const char *buffer, size_t count)
 {
-    int status;
+    char output[BUFSIZ*2];
+    size_t i, block, length;
+    ssize_t status;
+    char c;
 
-    /* Map output character */
-    if ((output_char == 127) && (map_o_del_bs))
-    {
-        output_char = '\b';
-    }
-    if ((output_char == '\r') && (map_o_cr_nl))
+    while (count > 0)
     {
-        output_char = '\n';
-    }
+        block = MIN(count, BUFSIZ);
 
-    /* Map newline character */
-    if ((output_char == '\n' || output_char == '\r') && (map_o_nl_crnl))
-    {
-        const char *crlf = "\r\n";
+        /* Map output characters, newline mapping may double the size */
+        for (i = 0, length = 0; i < block; i++)
+        {
+            c = buffer[i];
+
+            if ((c == 127) && (map_o_del_bs))
+            {
+                c = '\b';
+            }
+            if ((c == '\r') && (map_o_cr_nl))
+            {
+                c = '\n';
+            }
+
+            if ((c == '\n' || c == '\r') && (map_o_nl_crnl))
+            {
+                output[length++] = '\r';
+                output[length++] = '\n';
+            }
+            else
+            {
+                output[length++] = c;
+            }
+        }
+
+        if (option.local_echo)
+        {
+            print_buffer_write(output, length);
+            if (option.log)
+            {
+                log_write(output, length);
+            }
+        }
 
-        optional_local_echo(crlf[0]);
-        optional_local_echo(crlf[1]);
-        status = tty_write(fd, crlf, 2);
+        /* Send output to tty device */
+        status = tty_write(fd, output, length);
         if (status < 0)
         {
             tio_warning_printf("Could not write to tty device");
         }
 
-        tx_total += 2;
+        /* Update transmit statistics */
+        tx_total += length;
+
+        buffer += block;
+        count -= block;
+    }
+}
+
+void forward_to_tty(int fd, char output_char)
+{
+    if (option.hex_mode)
+    {
+        output_hex(output_char);
     }
     else
     {
-        if (option.hex_mode)
-        {
-            output_hex(output_char);
-        }
-        else
-        {
-            /* Send output to tty device */
-            optional_local_echo(output_char);
-            status = tty_write(fd, &output_char, 1);
-            if (status < 0)
-            {
-                tio_warning_printf("Could not write to tty device");
-            }
+        forward_buffer_to_tty(fd, &output_char, 1);
+    }
+}
 
-            /* Update transmit statistics */
-            tx_total++;
+/* Return true if events include received data from tty device */
+static bool tty_input_ready(const struct event_t *events, int count)
+{
+    for (int n = 0; n < count; n++)
+    {
+        if (((events[n].fd == fd) && (events[n].events & EVENT_READ)) || (events[n].fd == rx_pipefd[0]))
+        {
+            return true;
         }
     }
+
+    return false;
 }
 
 int tty_connect(void)
 {
-    fd_set rdfs;           /* Read file descriptor set */
-    int    maxfd;          /* Maximum file descriptor used */
+    struct event_t events[EVENTS_MAX];
     char   input_char, output_char;
     char   input_buffer[BUFSIZ];
     static bool first = true;
     int    status;
-    bool   next_timestamp = false;
-    char*  now = NULL;
-    struct timeval tv;
-    struct timeval *tv_p = &tv;
-    bool   ignore_stdin = false;
-#if (ENABLE_PARALLEL_KEYBOARD == true)
-    char   mount_string[16];    //by Evandro Souza. This variable has to be known inside this context, updated by check_input_char
-#endif  //#if (ENABLE_PARALLEL_KEYBOARD == true)
+    long   timeout;
+    long   flush_timeout;
+    long   stats_timeout;
+    long   pace_wait;
+    long   cts_recheck;
+    long   script_wait;
+    long   icount_wait;
+    bool   timer_wakeup;
 
     /* Open tty device */
     fd = open(option.tty_device, O_RDWR | O_NOCTTY | O_NONBLOCK);
@@ -1276,10 +2255,9 @@ int tty_connect(void)
     /* Fire alert action */
     alert_connect();
 
-    if (option.timestamp)
-    {
-        next_timestamp = true;
-    }
+    next_timestamp = (option.timestamp != TIMESTAMP_NONE);
+
+    print_hexdump_reset();
 
     /* Manage print output mode */
     if (option.hex_mode)
@@ -1343,138 +2321,288 @@ int tty_connect(void)
     mount_string[0] = 0;                    //by Evandro Souza.
 #endif  //#if (ENABLE_PARALLEL_KEYBOARD == true)
 
+    /* Sample serial error counters */
+    icount_reset(fd);
+
+    /* Start new output pacing schedule */
+    pace_configure();
+    output_queue_supported = true;
+
+    /* Device starts out accepting output */
+    soft_flow_control = (strcmp("soft", option.flow) == 0);
+    xonxoff_reset();
+    if (strcmp("hard", option.flow) == 0)
+    {
+        cts_start(fd);
+    }
+
+    /* Listen for input from tty device, directly or via reader thread */
+    if (option.rx_buffer_size > 0)
+    {
+        tty_rx_thread_start();
+    }
+    else
+    {
+        tty_set_events(EVENT_READ);
+    }
+
+    /* Listen for input from socket clients */
+    socket_enable_clients(true);
+
+    /* Transfer file requested on command line then quit */
+    if (option.send_file || option.receive_file)
+    {
+        status = tty_transfer_file(option.receive_file != NULL, option.transfer_protocol,
+                                   option.receive_file ? option.receive_file : option.send_file);
+        exit((status == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    /* Run script from the beginning on every connect */
+    script_start();
+
     /* Input loop */
     while (true)
     {
-        FD_ZERO(&rdfs);
-        FD_SET(fd, &rdfs);
-        if (!ignore_stdin)
-        {
-            FD_SET(pipefd[0], &rdfs);
-        }
-        maxfd = MAX(fd, pipefd[0]);
-        maxfd = MAX(maxfd, socket_add_fds(&rdfs, true));
-
         /* Manage timeout */
         if ((option.response_wait) && (option.response_timeout != 0))
         {
             // Set response timeout
-            tv_p->tv_sec = 0;
-            tv_p->tv_usec = option.response_timeout * 1000;
+            timeout = option.response_timeout * 1000L;
         }
         else
         {
             // No timeout
-            tv_p = NULL;
+            timeout = -1;
+        }
+
+        /* Continue sending file as output drains */
+        tty_send_file_feed();
+
+        /* Run script until it waits for input or time to pass */
+        status = script_run(fd);
+        if (status >= 0)
+        {
+            tty_exit_when_drained(status);
+        }
+        tty_sync(fd);
+
+        if (exit_pending && (tx_queue_count == 0))
+        {
+            exit(exit_status);
+        }
+
+        /* Queue log output not yet submitted with received data */
+        if (option.log && uring_enabled())
+        {
+            log_queue();
+        }
+
+        /* Flush pending output now or wake up when flush latency expires */
+        flush_timeout = print_buffer_flush_timeout();
+        timer_wakeup = false;
+        if (flush_timeout == 0)
+        {
+            print_buffer_queue();
+        }
+        else if ((flush_timeout > 0) && ((timeout < 0) || (flush_timeout < timeout)))
+        {
+            timeout = flush_timeout;
+            timer_wakeup = true;
+        }
+
+        /* Hand queued output to io_uring without waiting for it */
+        uring_submit();
+
+        /* Print statistics now or wake up when next interval begins */
+        stats_timeout = statistics_timeout();
+        if ((stats_timeout >= 0) && ((timeout < 0) || (stats_timeout < timeout)))
+        {
+            timeout = stats_timeout;
+            timer_wakeup = true;
+        }
+
+        /* Release paced output now or wake up when next character is due */
+        pace_wait = pace_timeout();
+        if (pace_wait == 0)
+        {
+            tty_sync(fd);
+            pace_wait = pace_timeout();
+        }
+        if ((pace_wait > 0) && ((timeout < 0) || (pace_wait < timeout)))
+        {
+            timeout = pace_wait;
+            timer_wakeup = true;
+        }
+
+        /* Read CTS again now and then while it holds output */
+        cts_recheck = cts_timeout();
+        if (cts_recheck == 0)
+        {
+            cts_refresh();
+            tty_sync(fd);
+            cts_recheck = cts_timeout();
+        }
+        if ((cts_recheck > 0) && ((timeout < 0) || (cts_recheck < timeout)))
+        {
+            timeout = cts_recheck;
+            timer_wakeup = true;
+        }
+
+        /* Poll error counters now or wake up when next poll is due */
+        icount_wait = icount_timeout();
+        if (icount_wait == 0)
+        {
+            icount_poll(fd);
+            icount_wait = icount_timeout();
+        }
+        if ((icount_wait > 0) && ((timeout < 0) || (icount_wait < timeout)))
+        {
+            timeout = icount_wait;
+            timer_wakeup = true;
+        }
+
+        /* Wake up when script step times out */
+        script_wait = script_timeout();
+        if ((script_wait >= 0) && ((timeout < 0) || (script_wait < timeout)))
+        {
+            timeout = script_wait;
+            timer_wakeup = true;
+        }
+
+        /* Only poll for other input while data is left in receive buffer */
+        if (rx_backlog)
+        {
+            timeout = 0;
+        }
+
+        /* Flush held back output as soon as no more received data is ready,
+         * flush latency only applies while data keeps arriving */
+        status = 0;
+        if ((print_buffer_flush_timeout() > 0) && !rx_backlog)
+        {
+            status = event_wait(events, EVENTS_MAX, 0);
+            if ((status >= 0) && !tty_input_ready(events, status))
+            {
+                print_buffer_queue();
+                uring_submit();
+            }
         }
 
         /* Block until input becomes available */
-        status = select(maxfd + 1, &rdfs, NULL, NULL, tv_p);
-        if (status > 0)
+        if (status == 0)
+        {
+            status = event_wait(events, EVENTS_MAX, timeout);
+        }
+        if ((status == -1) && (errno == EINTR))
+        {
+            // Interrupted by io_uring completion work
+            continue;
+        }
+        else if (status == -1)
+        {
+            tio_error_printf("Waiting for events failed (%s)", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        else if ((status == 0) && !timer_wakeup && !rx_backlog)
+        {
+            // Timeout (only happens in response wait mode)
+            exit(EXIT_FAILURE);
+        }
+
+        /* Continue processing data left in receive buffer */
+        if (rx_backlog && (tty_rx_process() < 0))
+        {
+            tio_error_printf_silent("Could not read from tty device");
+            goto error_read;
+        }
+
+        for (int n = 0; n < status; n++)
         {
             bool forward = false;
-            if (FD_ISSET(fd, &rdfs))
+            if (events[n].fd == fd)
             {
-                /* Input from tty device ready */
-                ssize_t bytes_read = read(fd, input_buffer, BUFSIZ);
-                if (bytes_read <= 0)
+                /* Device accepts more output */
+                if (events[n].events & EVENT_WRITE)
                 {
-                    /* Error reading - device is likely unplugged */
-                    tio_error_printf_silent("Could not read from tty device");
-                    goto error_read;
+                    tty_sync(fd);
                 }
 
-                /* Update receive statistics */
-                rx_total += bytes_read;
-
-                /* Process input byte by byte */
-                for (int i=0; i<bytes_read; i++)
+                /* Device is read by reader thread if enabled */
+                if (!(events[n].events & EVENT_READ) || rx_thread_running)
                 {
-                    input_char = input_buffer[i];
+                    continue;
+                }
 
-#if (ENABLE_PARALLEL_KEYBOARD == true)      // by Evandro Souza
-                    // Start Display pressed keys from MSX Keyboard Emulator readings
-                    if(show_parallel_keyboard)
+                /* Input from tty device ready */
+                ssize_t bytes_read;
+
+                if (passthrough_possible())
+                {
+                    /* Forward input to all destinations without copying */
+                    print_buffer_flush();
+                    bytes_read = passthrough_forward(fd);
+                    if (bytes_read > 0)
+                    {
+                        rx_total += bytes_read;
+                        print_tainted = true;
+                        icount_received();
+                        continue;
+                    }
+                    if ((bytes_read < 0) && (errno == EAGAIN))
                     {
-                        /* Parse reception to show up on key maping */
-                        check_input_kb_event(input_char, mount_string);
+                        continue;
                     }
-                    else //if(show_parallel_keyboard)
+                    if ((bytes_read < 0) && ((errno == EINVAL) || (errno == ENOSYS)))
                     {
-                        /* By Evandro Souza => End Display pressed keys from MSX Keyboard Emulator readings */
-#endif  //#if (ENABLE_PARALLEL_KEYBOARD == true)
-                        /* Print timestamp on new line if enabled */
-                        if ((next_timestamp && input_char != '\n' && input_char != '\r') && !option.hex_mode)
-                        {
-                            now = timestamp_current_time();
-                            if (now)
-                            {
-                                ansi_printf_raw("[%s] ", now);
-                                if (option.log)
-                                {
-                                    log_printf("[%s] ", now);
-                                }
-                                next_timestamp = false;
-                            }
-                                                   
-                        }
-                     
-                        /* Convert MSB to LSB bit order */
-                        if (map_o_msblsb)
-                        {
-                            char ch = input_char;
-                            input_char = 0;
-                            for (int j = 0; j < 8; ++j)
-                            {
-                                input_char |= ((1 << j) & ch) ? (1 << (7 - j)) : 0;
-                            }
-                        }
-                     
-                        /* Map input character */
-                        if ((input_char == '\n') && (map_i_nl_crnl) && (!map_o_msblsb))
-                        {
-                            print('\r');
-                            print('\n');
-                            if (option.timestamp)
-                            {
-                                next_timestamp = true;
-                            }
-                        }
-                        else
-                        {
-                            /* Print received tty character to stdout */
-                            print(input_char);
-                        }
-
-                        /* Write to log */
-                        if (option.log)
-                        {
-                            log_putc(input_char);
-                        }
-
-                        socket_write(input_char);
-
-                        print_tainted = true;
+                        /* Not supported by device, fall back to regular read */
+                        passthrough_supported = false;
+                    }
+                    else
+                    {
+                        /* Error reading - device is likely unplugged */
+                        tio_error_printf_silent("Could not read from tty device");
+                        goto error_read;
+                    }
+                }
 
-                        if (input_char == '\n' && option.timestamp)
-                        {
-                            next_timestamp = true;
-                        }
+                bytes_read = read(fd, input_buffer, BUFSIZ);
+                if (bytes_read <= 0)
+                {
+                    /* Error reading - device is likely unplugged */
+                    tio_error_printf_silent("Could not read from tty device");
+                    goto error_read;
+                }
 
-                        if (option.response_wait)
-                        {
-                            if ((input_char == '\r') || (input_char == '\n'))
-                            {
-                                tty_sync(fd);
-                                exit(EXIT_SUCCESS);
-                            }
-                        }
-#if (ENABLE_PARALLEL_KEYBOARD == true)      // by Evandro Souza
-                    }	//else if(show_parallel_keyboard)
-#endif  //#if (ENABLE_PARALLEL_KEYBOARD == true)
-                }	//for (int i=0; i<bytes_read; i++)
+                receive_input(input_buffer, bytes_read);
+            }
+            else if (events[n].fd == pace_fd())
+            {
+                /* Paced output is due */
+                pace_acknowledge();
+                tty_sync(fd);
+            }
+            else if (events[n].fd == cts_fd())
+            {
+                /* CTS changed */
+                cts_acknowledge();
+                tty_sync(fd);
+            }
+            else if (events[n].fd == rx_pipefd[0])
+            {
+                /* Input from reader thread ready */
+                if (tty_rx_process() < 0)
+                {
+                    /* Error reading - device is likely unplugged */
+                    tio_error_printf_silent("Could not read from tty device");
+                    goto error_read;
+                }
             }
-            else if (FD_ISSET(pipefd[0], &rdfs))
+            else if (events[n].fd == uring_fd())
+            {
+                /* Output submitted via io_uring completed */
+                uring_reap();
+            }
+            else if (events[n].fd == pipefd[0])
             {
                 /* Input from stdin ready */
                 ssize_t bytes_read = read(pipefd[0], input_buffer, BUFSIZ);
@@ -1485,27 +2613,41 @@ int tty_connect(void)
                 }
                 else if (bytes_read == 0)
                 {
-                    /* Reached EOF (when piping to stdin) */
-                    if (option.response_wait)
-                    {
-                        /* Stdin pipe closed but not blocking so stop listening
-                         * to stdin in response mode.
-                         *
-                         * Note: select() really indicates not if data is ready
-                         * but if file descriptor is non-blocking for I/O
-                         * operation. */
-                        ignore_stdin = true;
-                    }
-                    else
+                    /* Reached EOF (when piping to stdin). Stdin pipe closed
+                     * but keeps reporting readable so stop listening to it,
+                     * in response mode tio quits on response instead. */
+                    event_remove(pipefd[0]);
+                    stdin_closed = true;
+                    if (!option.response_wait)
                     {
-                        tty_sync(fd);
-                        exit(EXIT_SUCCESS);
+                        tty_exit_when_drained(EXIT_SUCCESS);
                     }
                 }
 
-                /* Process input byte by byte */
                 for (int i=0; i<bytes_read; i++)
                 {
+                    /* Input is file name while it is being entered */
+                    if (filename_entry())
+                    {
+                        filename_input(input_buffer[i]);
+                        continue;
+                    }
+
+                    /* Forward plain input in bulk up to next prefix key */
+                    if (tty_bulk_input_possible())
+                    {
+                        char *prefix = interactive_mode ? memchr(input_buffer + i, option.prefix_code, bytes_read - i) : NULL;
+                        int length = (prefix != NULL) ? (prefix - (input_buffer + i)) : (bytes_read - i);
+
+                        if (length > 0)
+                        {
+                            forward_buffer_to_tty(fd, input_buffer + i, length);
+                            i += length - 1;
+                            continue;
+                        }
+                    }
+
+                    /* Process prefix key and command sequences byte by byte */
                     input_char = input_buffer[i];
 
                     /* Forward input to output */
@@ -1520,6 +2662,7 @@ int tty_connect(void)
                         {
                             //Returns to default terminal
                             show_parallel_keyboard = false;
+                            print_buffer_flush();
                             printf("\x1B[%d;%dH\r\n", 24, 0);//last line
                             forward = false;    //Do not forward this <Esc>
                         }
@@ -1544,37 +2687,63 @@ int tty_connect(void)
                         }
                     } //if (interactive_mode)
 
+                    /* Only key commands and abort key are handled while sending file */
+                    if (forward && send_file_active())
+                    {
+                        if (input_char == TIO_ABORT)
+                        {
+                            /* Stop sending, including file data still queued */
+                            send_file_abort();
+                            tx_queue_start = tx_queue_count = 0;
+                        }
+                        forward = false;
+                    }
+
                     if (forward)
                     {
                         forward_to_tty(fd, output_char);
                     }
                 } //or (int i=0; i<bytes_read; i++)
 
+                /* Show local echo immediately */
+                print_buffer_flush();
+
                 tty_sync(fd);
             }
             else
             {
+                /* Socket client accepts more queued output */
+                if (events[n].events & EVENT_WRITE)
+                {
+                    socket_handle_output(events[n].fd);
+                }
+                if (!(events[n].events & EVENT_READ))
+                {
+                    continue;
+                }
+
                 /* Input from socket ready */
-                forward = socket_handle_input(&rdfs, &output_char);
+                size_t bytes_read = socket_handle_input(events[n].fd, input_buffer, BUFSIZ);
 
-                if (forward)
+                if (option.hex_mode)
+                {
+                    /* Hex input is parsed character by character */
+                    for (size_t i = 0; i < bytes_read; i++)
+                    {
+                        forward_to_tty(fd, input_buffer[i]);
+                    }
+                }
+                else if (bytes_read > 0)
                 {
-                    forward_to_tty(fd, output_char);
+                    /* Map and queue whole chunk at once */
+                    forward_buffer_to_tty(fd, input_buffer, bytes_read);
                 }
 
+                print_buffer_flush();
+
                 tty_sync(fd);
             }
         }
-        else if (status == -1)
-        {
-            tio_error_printf("select() failed (%s)", strerror(errno));
-            exit(EXIT_FAILURE);
-        }
-        else
-        {
-            // Timeout (only happens in response wait mode)
-            exit(EXIT_FAILURE);
-        }
     }   //while (true)
 
     return TIO_SUCCESS;
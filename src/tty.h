@@ -22,6 +22,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 
 extern bool interactive_mode;
 
@@ -33,5 +34,6 @@ void	tty_disconnect(void);					//By Evandro Souza, to allow linking with extensi
 void	tty_wait_for_device(void);
 void	list_serial_devices(void);
 void  forward_to_tty(int, char);		//By Evandro Souza, to allow linking with extension.c
+void  forward_buffer_to_tty(int fd, const char *buffer, size_t count);
 void  tty_input_thread_create(void);
 void  tty_input_thread_wait_ready(void);
@@ -0,0 +1,498 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Batched output via io_uring
+ *
+ * Writes queued with uring_write() are submitted together by uring_submit()
+ * using a single io_uring_enter() call which does not wait for them. Data is
+ * copied into a buffer owned by the request and kept until its completion
+ * arrives, so callers may reuse their buffers right away. Completions are
+ * reaped by uring_reap() when the main loop sees the ring become readable.
+ *
+ * Writes to the same file descriptor are issued one at a time to keep output
+ * in order. Short writes are resubmitted for the remainder and writes which
+ * fail with EAGAIN are resubmitted behind a linked poll for POLLOUT, so the
+ * main loop never blocks on a slow destination. Synchronous writers must call
+ * uring_wait() for the file descriptor first.
+ *
+ * The ring is set up with the raw system calls so no library is required.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include "uring.h"
+#include "event.h"
+#include "print.h"
+
+#ifdef HAVE_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES 64
+#define URING_POLL_TAG ((uint64_t) -1)
+
+struct uring_request_t
+{
+    int fd;
+    char *buffer;
+    size_t size;
+    size_t count;
+    size_t done;
+    bool in_flight;
+    bool finished;
+    bool again;
+    void (*error)(int fd);
+};
+
+static int ring_fd = -1;
+static unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+static unsigned *cq_head, *cq_tail, *cq_mask;
+static struct io_uring_sqe *sqes;
+static struct io_uring_cqe *cqes;
+static unsigned sq_entries;
+static unsigned unsubmitted = 0;
+
+/* Requests in order of queueing */
+static struct uring_request_t requests[URING_ENTRIES];
+static unsigned request_head = 0;
+static unsigned request_count = 0;
+
+static void uring_exit(void)
+{
+    uring_wait(-1);
+}
+
+int uring_init(void)
+{
+    struct io_uring_params params;
+    size_t sq_size, cq_size;
+    char *sq_ring, *cq_ring;
+
+    memset(&params, 0, sizeof(params));
+
+    ring_fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ring_fd < 0)
+    {
+        return -1;
+    }
+
+    /* Writes to the log file rely on the current file position */
+    if (!(params.features & IORING_FEAT_RW_CUR_POS))
+    {
+        goto error;
+    }
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        sq_size = cq_size = (sq_size > cq_size) ? sq_size : cq_size;
+    }
+
+    sq_ring = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED)
+    {
+        goto error;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        cq_ring = sq_ring;
+    }
+    else
+    {
+        cq_ring = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED)
+        {
+            goto error;
+        }
+    }
+
+    sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        goto error;
+    }
+
+    sq_head = (unsigned *) (sq_ring + params.sq_off.head);
+    sq_tail = (unsigned *) (sq_ring + params.sq_off.tail);
+    sq_mask = (unsigned *) (sq_ring + params.sq_off.ring_mask);
+    sq_array = (unsigned *) (sq_ring + params.sq_off.array);
+    cq_head = (unsigned *) (cq_ring + params.cq_off.head);
+    cq_tail = (unsigned *) (cq_ring + params.cq_off.tail);
+    cq_mask = (unsigned *) (cq_ring + params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *) (cq_ring + params.cq_off.cqes);
+    sq_entries = params.sq_entries;
+
+    /* Wake up main loop when completions arrive */
+    if (event_add(ring_fd, EVENT_READ) < 0)
+    {
+        goto error;
+    }
+
+    atexit(uring_exit);
+
+    return 0;
+
+error:
+    close(ring_fd);
+    ring_fd = -1;
+    return -1;
+}
+
+bool uring_enabled(void)
+{
+    return ring_fd >= 0;
+}
+
+int uring_fd(void)
+{
+    return ring_fd;
+}
+
+static void uring_enter(unsigned min_complete)
+{
+    int status;
+
+    do
+    {
+        status = syscall(__NR_io_uring_enter, ring_fd, unsubmitted, min_complete,
+                         (min_complete > 0) ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (status > 0)
+        {
+            unsubmitted -= ((unsigned) status < unsubmitted) ? (unsigned) status : unsubmitted;
+        }
+    }
+    while ((status < 0) && (errno == EINTR));
+
+    if ((status < 0) && (errno != EAGAIN) && (errno != EBUSY))
+    {
+        tio_error_printf("io_uring_enter() failed (%s)", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static struct io_uring_sqe *uring_get_sqe(void)
+{
+    struct io_uring_sqe *sqe;
+    unsigned tail, index;
+
+    /* Hand prepared entries to the kernel when submission queue is full */
+    tail = *sq_tail;
+    if ((tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE)) == sq_entries)
+    {
+        uring_enter(0);
+    }
+
+    index = tail & *sq_mask;
+    sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+
+    return sqe;
+}
+
+static void uring_put_sqe(void)
+{
+    __atomic_store_n(sq_tail, *sq_tail + 1, __ATOMIC_RELEASE);
+    unsubmitted++;
+}
+
+/* Prepare write of what is left of request */
+static void uring_start(unsigned slot)
+{
+    struct uring_request_t *request = &requests[slot];
+    struct io_uring_sqe *sqe;
+
+    if (request->again)
+    {
+        /* Destination was full, write once it accepts data again */
+        sqe = uring_get_sqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = request->fd;
+        sqe->poll_events = POLLOUT;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = URING_POLL_TAG;
+        uring_put_sqe();
+    }
+
+    sqe = uring_get_sqe();
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = request->fd;
+    sqe->addr = (uintptr_t) (request->buffer + request->done);
+    sqe->len = request->count - request->done;
+    sqe->off = (uint64_t) -1;   // Use current file position
+    sqe->user_data = slot;
+    uring_put_sqe();
+
+    request->in_flight = true;
+}
+
+/* Return true if an earlier request for the same file descriptor is outstanding */
+static bool uring_blocked(unsigned slot)
+{
+    for (unsigned i = request_head; i != slot; i = (i + 1) % URING_ENTRIES)
+    {
+        if (!requests[i].finished && (requests[i].fd == requests[slot].fd))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Start next queued request for file descriptor */
+static void uring_start_next(int fd)
+{
+    unsigned slot;
+
+    for (unsigned i = 0; i < request_count; i++)
+    {
+        slot = (request_head + i) % URING_ENTRIES;
+        if (!requests[slot].finished && (requests[slot].fd == fd))
+        {
+            if (!requests[slot].in_flight)
+            {
+                uring_start(slot);
+            }
+            return;
+        }
+    }
+}
+
+static void uring_complete(unsigned slot, int result)
+{
+    struct uring_request_t *request = &requests[slot];
+
+    request->in_flight = false;
+    request->again = false;
+
+    if ((result == -EAGAIN) || (result == -EINTR))
+    {
+        request->again = (result == -EAGAIN);
+        uring_start(slot);
+        return;
+    }
+
+    if (result >= 0)
+    {
+        request->done += result;
+        if (request->done < request->count)
+        {
+            /* Resubmit remainder of short write */
+            uring_start(slot);
+            return;
+        }
+    }
+    else if (request->error != NULL)
+    {
+        request->error(request->fd);
+    }
+    else
+    {
+        tio_debug_printf("Write error on fd %d (%s)", request->fd, strerror(-result));
+    }
+
+    request->finished = true;
+    uring_start_next(request->fd);
+}
+
+void uring_reap(void)
+{
+    unsigned head, tail;
+
+    if (ring_fd < 0)
+    {
+        return;
+    }
+
+    head = *cq_head;
+    tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail)
+    {
+        struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+        if (cqe->user_data != URING_POLL_TAG)
+        {
+            uring_complete(cqe->user_data, cqe->res);
+        }
+        head++;
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+    /* Release finished requests in order, keeping their buffers for reuse */
+    while ((request_count > 0) && requests[request_head].finished)
+    {
+        request_head = (request_head + 1) % URING_ENTRIES;
+        request_count--;
+    }
+
+    /* Submit resubmissions and next writes */
+    if (unsubmitted > 0)
+    {
+        uring_enter(0);
+    }
+}
+
+/* Return true if requests for file descriptor, or any if -1, are outstanding */
+static bool uring_outstanding(int fd)
+{
+    for (unsigned i = 0; i < request_count; i++)
+    {
+        struct uring_request_t *request = &requests[(request_head + i) % URING_ENTRIES];
+        if (!request->finished && ((fd < 0) || (request->fd == fd)))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Block until queued writes to file descriptor, or all if -1, have completed */
+void uring_wait(int fd)
+{
+    if (ring_fd < 0)
+    {
+        return;
+    }
+
+    uring_reap();
+    while (uring_outstanding(fd))
+    {
+        uring_enter(1);
+        uring_reap();
+    }
+}
+
+void uring_write(int fd, const void *buffer, size_t count, void (*error)(int fd))
+{
+    struct uring_request_t *request;
+    unsigned slot;
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    /* Make room when output has stalled on all requests */
+    while (request_count == URING_ENTRIES)
+    {
+        uring_enter(1);
+        uring_reap();
+    }
+
+    slot = (request_head + request_count) % URING_ENTRIES;
+    request = &requests[slot];
+
+    if (request->size < count)
+    {
+        char *resized = realloc(request->buffer, count);
+        if (resized == NULL)
+        {
+            tio_error_printf("Out of memory");
+            exit(EXIT_FAILURE);
+        }
+        request->buffer = resized;
+        request->size = count;
+    }
+
+    memcpy(request->buffer, buffer, count);
+    request->fd = fd;
+    request->count = count;
+    request->done = 0;
+    request->in_flight = false;
+    request->finished = false;
+    request->again = false;
+    request->error = error;
+    request_count++;
+
+    if (!uring_blocked(slot))
+    {
+        uring_start(slot);
+    }
+}
+
+/* Submit queued writes without waiting for them to complete */
+void uring_submit(void)
+{
+    if ((ring_fd < 0) || (unsubmitted == 0))
+    {
+        return;
+    }
+
+    uring_enter(0);
+
+    /* Writes which completed inline are released right away */
+    uring_reap();
+}
+
+#else
+
+int uring_init(void)
+{
+    return -1;
+}
+
+bool uring_enabled(void)
+{
+    return false;
+}
+
+void uring_write(int fd, const void *buffer, size_t count, void (*error)(int fd))
+{
+    (void) fd;
+    (void) buffer;
+    (void) count;
+    (void) error;
+}
+
+int uring_fd(void)
+{
+    return -1;
+}
+
+void uring_submit(void)
+{
+}
+
+void uring_reap(void)
+{
+}
+
+void uring_wait(int fd)
+{
+    (void) fd;
+}
+
+#endif
@@ -0,0 +1,129 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Software flow control (XON/XOFF) of output
+ *
+ * Tracks XON/XOFF characters received from the device so that tio can hold
+ * back all output while the device has asked it to pause. The characters
+ * are removed from the received data like the kernel does when it handles
+ * software flow control itself.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "xonxoff.h"
+#include "print.h"
+
+#define XON  0x11
+#define XOFF 0x13
+
+static bool paused = false;
+static unsigned long pause_count = 0;
+static int64_t pause_total = 0;     // us
+static struct timespec pause_start;
+
+static int64_t elapsed_us(const struct timespec *since)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - since->tv_sec) * 1000000LL + (now.tv_nsec - since->tv_nsec) / 1000;
+}
+
+static void xonxoff_set(bool pause)
+{
+    if (pause == paused)
+    {
+        return;
+    }
+
+    if (pause)
+    {
+        pause_count++;
+        clock_gettime(CLOCK_MONOTONIC, &pause_start);
+    }
+    else
+    {
+        pause_total += elapsed_us(&pause_start);
+    }
+
+    paused = pause;
+}
+
+/* Resume output, e.g. when connecting to device */
+void xonxoff_reset(void)
+{
+    xonxoff_set(false);
+}
+
+/* Remove XON/XOFF from received data and track their effect, returns new
+ * count and sets changed if output was paused or resumed */
+size_t xonxoff_filter(char *buffer, size_t count, bool *changed)
+{
+    bool was_paused = paused;
+    size_t i, length = 0;
+
+    *changed = false;
+
+    if ((memchr(buffer, XON, count) == NULL) && (memchr(buffer, XOFF, count) == NULL))
+    {
+        return count;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (buffer[i] == XOFF)
+        {
+            xonxoff_set(true);
+        }
+        else if (buffer[i] == XON)
+        {
+            xonxoff_set(false);
+        }
+        else
+        {
+            buffer[length++] = buffer[i];
+        }
+    }
+
+    *changed = (paused != was_paused);
+
+    return length;
+}
+
+bool xonxoff_paused(void)
+{
+    return paused;
+}
+
+void xonxoff_print(void)
+{
+    int64_t total = pause_total + (paused ? elapsed_us(&pause_start) : 0);
+
+    tio_printf(" Output paused %lu times by XOFF for %lld.%03lld s%s", pause_count,
+               (long long) (total / 1000000), (long long) ((total / 1000) % 1000),
+               paused ? " (paused now)" : "");
+}
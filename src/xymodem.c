@@ -0,0 +1,1996 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * XMODEM, YMODEM and ZMODEM file transfers
+ *
+ * Supports sending and receiving with XMODEM (128 byte blocks, CRC16 or
+ * checksum), XMODEM-1K (1024 byte blocks, CRC16), YMODEM batch transfers
+ * and ZMODEM streaming transfers. Transfers take over the tty device until
+ * done or aborted by pressing ESC.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <libgen.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include "xymodem.h"
+#include "options.h"
+#include "print.h"
+
+#define SOH 0x01
+#define STX 0x02
+#define EOT 0x04
+#define ACK 0x06
+#define NAK 0x15
+#define CAN 0x18
+#define SUB 0x1a
+#define CRC 'C'
+#define ESC 0x1b
+
+#define BLOCK_SIZE      128
+#define BLOCK_SIZE_1K   1024
+#define RETRY_MAX       10
+#define START_TIMEOUT   60000   // ms
+#define START_INTERVAL  3000    // ms
+#define ACK_TIMEOUT     10000   // ms
+#define BYTE_TIMEOUT    1000    // ms
+#define PROGRESS_INTERVAL 1000000   // us
+
+enum packet_t
+{
+    PACKET_DATA,
+    PACKET_EOT,
+    PACKET_CANCEL,
+    PACKET_ERROR,
+    PACKET_TIMEOUT,
+    PACKET_ABORT,
+};
+
+static const uint16_t crc16_table[256] =
+{
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
+    0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
+    0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
+    0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+    0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+    0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
+    0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+    0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
+    0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+    0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
+    0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+    0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
+    0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
+    0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
+    0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
+    0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+    0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+    0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+    0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
+    0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+    0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
+    0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0,
+};
+
+static int tty_fd = -1;
+static int input_fd = -1;
+static unsigned char rx_buffer[BUFSIZ];
+static size_t rx_start = 0;
+static size_t rx_count = 0;
+static bool aborted = false;
+static size_t transfer_total;
+static size_t transfer_size;
+static struct timespec transfer_start;
+static struct timespec transfer_progress;
+
+/* CRC16-CCITT (XMODEM), polynomial 0x1021 */
+static uint16_t crc16_update(uint16_t crc, const unsigned char *data, size_t length)
+{
+    while (length--)
+    {
+        crc = (crc << 8) ^ crc16_table[((crc >> 8) ^ *data++) & 0xff];
+    }
+
+    return crc;
+}
+
+static uint16_t crc16(const unsigned char *data, size_t length)
+{
+    return crc16_update(0, data, length);
+}
+
+static unsigned char checksum(const unsigned char *data, size_t length)
+{
+    unsigned char sum = 0;
+
+    while (length--)
+    {
+        sum += *data++;
+    }
+
+    return sum;
+}
+
+static int64_t elapsed_us(const struct timespec *since)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - since->tv_sec) * 1000000LL + (now.tv_nsec - since->tv_nsec) / 1000;
+}
+
+static void progress_start(size_t size)
+{
+    transfer_total = 0;
+    transfer_size = size;
+    clock_gettime(CLOCK_MONOTONIC, &transfer_start);
+    transfer_progress = transfer_start;
+}
+
+static void progress_print(const char *verb, bool done)
+{
+    int64_t us = elapsed_us(&transfer_start);
+    long rate = (us > 0) ? (long) (transfer_total * 1000000LL / us) : 0;
+
+    if (!done && (elapsed_us(&transfer_progress) < PROGRESS_INTERVAL))
+    {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &transfer_progress);
+
+    if (transfer_size > 0)
+    {
+        tio_printf("%s %zu of %zu bytes (%d%%), %ld bytes/s", verb, transfer_total, transfer_size,
+                   (int) (MIN(transfer_total, transfer_size) * 100 / transfer_size), rate);
+    }
+    else
+    {
+        tio_printf("%s %zu bytes, %ld bytes/s", verb, transfer_total, rate);
+    }
+}
+
+/* Discard user input, returns true if transfer abort was requested */
+static bool check_abort_input(void)
+{
+    char buffer[64];
+    ssize_t count = read(input_fd, buffer, sizeof(buffer));
+
+    if (count <= 0)
+    {
+        // Input closed, stop watching it
+        input_fd = -1;
+        return false;
+    }
+
+    return memchr(buffer, ESC, count) != NULL;
+}
+
+/* Wait up to timeout ms for input from tty device while watching for abort */
+static void fill_input(int timeout)
+{
+    struct pollfd fds[2];
+    ssize_t count;
+    int status;
+
+    fds[0].fd = tty_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = input_fd;
+    fds[1].events = POLLIN;
+
+    status = poll(fds, (input_fd >= 0) ? 2 : 1, timeout);
+    if ((status < 0) && (errno != EINTR))
+    {
+        aborted = true;
+        return;
+    }
+    if (status <= 0)
+    {
+        return;
+    }
+
+    if ((input_fd >= 0) && (fds[1].revents & (POLLIN | POLLHUP)) && check_abort_input())
+    {
+        tio_printf("Transfer aborted by user");
+        aborted = true;
+        return;
+    }
+
+    if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+    {
+        count = read(tty_fd, rx_buffer, sizeof(rx_buffer));
+        if (count > 0)
+        {
+            rx_start = 0;
+            rx_count = count;
+        }
+        else if ((count == 0) || ((errno != EAGAIN) && (errno != EINTR)))
+        {
+            tio_warning_printf("Could not read from tty device");
+            aborted = true;
+        }
+    }
+}
+
+/* Read one byte from tty device, returns -1 on timeout or abort */
+static int read_byte(int timeout)
+{
+    struct timespec start;
+    int64_t remaining;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while ((rx_count == 0) && !aborted)
+    {
+        remaining = timeout - elapsed_us(&start) / 1000;
+        if (remaining < 0)
+        {
+            return -1;
+        }
+
+        fill_input(remaining);
+    }
+
+    if (aborted)
+    {
+        return -1;
+    }
+
+    rx_count--;
+    return rx_buffer[rx_start++];
+}
+
+/* Discard input until line has been quiet for a while */
+static void purge_input(void)
+{
+    rx_count = 0;
+    while (read_byte(BYTE_TIMEOUT) >= 0);
+}
+
+static int write_all(const void *buffer, size_t count)
+{
+    struct pollfd pfd = { .fd = tty_fd, .events = POLLOUT };
+    ssize_t status;
+
+    while (count > 0)
+    {
+        status = write(tty_fd, buffer, count);
+        if (status < 0)
+        {
+            if ((errno == EAGAIN) || (errno == EINTR))
+            {
+                poll(&pfd, 1, ACK_TIMEOUT);
+                continue;
+            }
+            tio_warning_printf("Could not write to tty device (%s)", strerror(errno));
+            aborted = true;
+            return -1;
+        }
+        buffer = (const char *) buffer + status;
+        count -= status;
+    }
+
+    return 0;
+}
+
+static int write_byte(unsigned char c)
+{
+    return write_all(&c, 1);
+}
+
+static void cancel(void)
+{
+    const unsigned char sequence[] = { CAN, CAN, CAN, CAN, CAN };
+
+    write_all(sequence, sizeof(sequence));
+}
+
+/* Wait for receiver to request transfer, returns CRC or NAK (checksum mode) */
+static int wait_request(void)
+{
+    struct timespec start;
+    int c;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (elapsed_us(&start) < START_TIMEOUT * 1000LL)
+    {
+        c = read_byte(START_INTERVAL);
+        if (c == CRC || c == NAK)
+        {
+            return c;
+        }
+        if (c == CAN)
+        {
+            if (read_byte(BYTE_TIMEOUT) == CAN)
+            {
+                tio_warning_printf("Transfer cancelled by receiver");
+                return -1;
+            }
+        }
+        if (aborted)
+        {
+            return -1;
+        }
+    }
+
+    tio_warning_printf("Timeout waiting for receiver");
+    return -1;
+}
+
+/* Send one block and wait for it to be acknowledged */
+static int send_block(unsigned char number, const unsigned char *data, size_t length, bool crc)
+{
+    unsigned char block[BLOCK_SIZE_1K + 5];
+    size_t size = 0;
+    uint16_t crc16_value;
+    int c;
+
+    block[size++] = (length == BLOCK_SIZE_1K) ? STX : SOH;
+    block[size++] = number;
+    block[size++] = ~number;
+    memcpy(block + size, data, length);
+    size += length;
+    if (crc)
+    {
+        crc16_value = crc16(data, length);
+        block[size++] = crc16_value >> 8;
+        block[size++] = crc16_value & 0xff;
+    }
+    else
+    {
+        block[size++] = checksum(data, length);
+    }
+
+    for (int retry = 0; retry < RETRY_MAX; retry++)
+    {
+        if (write_all(block, size) < 0)
+        {
+            return -1;
+        }
+
+        /* Wait for response, ignoring anything else */
+        while (true)
+        {
+            c = read_byte(ACK_TIMEOUT);
+            if (c == ACK)
+            {
+                return 0;
+            }
+            if ((c == NAK) || (c < 0))
+            {
+                break;
+            }
+            if ((c == CAN) && (read_byte(BYTE_TIMEOUT) == CAN))
+            {
+                tio_warning_printf("Transfer cancelled by receiver");
+                return -1;
+            }
+        }
+
+        if (aborted)
+        {
+            return -1;
+        }
+    }
+
+    tio_warning_printf("Too many retries sending block %u", number);
+    return -1;
+}
+
+static int send_eot(void)
+{
+    for (int retry = 0; retry < RETRY_MAX; retry++)
+    {
+        if (write_byte(EOT) < 0)
+        {
+            return -1;
+        }
+
+        // Some receivers NAK first EOT to confirm end of file
+        if (read_byte(ACK_TIMEOUT) == ACK)
+        {
+            return 0;
+        }
+
+        if (aborted)
+        {
+            return -1;
+        }
+    }
+
+    tio_warning_printf("End of file not acknowledged");
+    return -1;
+}
+
+/* YMODEM block 0 with file name, size and modification time, empty at end of batch */
+static int send_header(const char *filename, const struct stat *st)
+{
+    unsigned char block[BLOCK_SIZE_1K];
+    size_t length = 0;
+    char *name;
+
+    memset(block, 0, sizeof(block));
+
+    if (filename != NULL)
+    {
+        name = strdup(filename);
+        snprintf((char *) block, BLOCK_SIZE, "%s", basename(name));
+        free(name);
+
+        length = strlen((char *) block) + 1;
+        snprintf((char *) block + length, sizeof(block) - length, "%lld %llo %o",
+                 (long long) st->st_size, (long long) st->st_mtime, (unsigned) st->st_mode);
+        length += strlen((char *) block + length) + 1;
+    }
+
+    return send_block(0, block, (length > BLOCK_SIZE) ? BLOCK_SIZE_1K : BLOCK_SIZE, true);
+}
+
+/* Create file for received data, an existing file is never replaced */
+static int open_output(const char *filename)
+{
+    int file_fd = open(filename, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+
+    if (file_fd < 0)
+    {
+        tio_warning_printf("Could not create file %s (%s)", filename, strerror(errno));
+        cancel();
+    }
+
+    return file_fd;
+}
+
+/* Create file in directory for data received under name chosen by sender.
+ * Only the last path component is used and a numeric suffix is added if a
+ * file of that name already exists. */
+static int open_received(const char *path, char *name, char *filename, size_t size)
+{
+    const char *base = basename(name);
+    int file_fd;
+
+    if ((base[0] == 0) || !strcmp(base, ".") || !strcmp(base, "..") || !strcmp(base, "/"))
+    {
+        tio_warning_printf("Invalid file name received");
+        cancel();
+        return -1;
+    }
+
+    snprintf(filename, size, "%s/%s", (path != NULL) ? path : ".", base);
+
+    for (int i = 1; i < 1000; i++)
+    {
+        file_fd = open(filename, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if ((file_fd >= 0) || (errno != EEXIST))
+        {
+            break;
+        }
+        snprintf(filename, size, "%s/%s.%d", (path != NULL) ? path : ".", base, i);
+    }
+
+    if (file_fd < 0)
+    {
+        tio_warning_printf("Could not create file %s (%s)", filename, strerror(errno));
+        cancel();
+    }
+
+    return file_fd;
+}
+
+/*
+ * ZMODEM
+ *
+ * Data is streamed in subpackets of a ZDATA frame without waiting for each
+ * to be acknowledged. The sender asks for an acknowledgement (ZCRCQ) every
+ * quarter window and stops to wait only when a window of data is not yet
+ * acknowledged, so the line is kept busy. A receiver detecting an error
+ * answers ZRPOS with the position to resume from.
+ */
+
+#define ZPAD        '*'
+#define ZDLE        0x18
+#define ZDLEE       (ZDLE ^ 0x40)
+#define ZBIN        'A'
+#define ZHEX        'B'
+#define ZBIN32      'C'
+#define XON         0x11
+#define XOFF        0x13
+
+/* Frame types */
+#define ZRQINIT     0
+#define ZRINIT      1
+#define ZSINIT      2
+#define ZACK        3
+#define ZFILE       4
+#define ZSKIP       5
+#define ZNAK        6
+#define ZABORT      7
+#define ZFIN        8
+#define ZRPOS       9
+#define ZDATA       10
+#define ZEOF        11
+#define ZFERR       12
+#define ZCRC        13
+#define ZCHALLENGE  14
+#define ZCAN        16
+
+/* Subpacket ends */
+#define ZCRCE       'h'     // End of frame, header follows
+#define ZCRCG       'i'     // Frame continues
+#define ZCRCQ       'j'     // Frame continues, ZACK expected
+#define ZCRCW       'k'     // End of frame, ZACK expected
+#define ZRUB0       'l'
+#define ZRUB1       'm'
+
+/* ZRINIT capabilities */
+#define CANFDX      0x01
+#define CANOVIO     0x02
+#define CANFC32     0x20
+#define ESCCTL      0x40
+
+/* Header bytes */
+#define ZP0         0
+#define ZP1         1
+#define ZF0         3
+
+#define ZMODEM_SUBPACKET    1024
+#define ZMODEM_WINDOW       32768
+#define ZMODEM_TIMEOUT      (-1)
+#define ZMODEM_ERROR        (-2)
+#define ZMODEM_CANCEL       (-3)
+#define ZMODEM_FRAME_END    0x100
+
+static uint32_t crc32_table[256];
+static bool escape_table[256];
+static unsigned char tx_buffer[2 * ZMODEM_SUBPACKET + 64];
+static size_t tx_count;
+static unsigned char tx_last;
+static bool tx_crc32;
+static bool rx_crc32;
+
+/* CRC32 as used by ZMODEM, reflected polynomial 0xedb88320 */
+static void crc32_init(void)
+{
+    uint32_t crc;
+
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        crc = i;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+        }
+        crc32_table[i] = crc;
+    }
+}
+
+static uint32_t crc32_update(uint32_t crc, const unsigned char *data, size_t length)
+{
+    while (length--)
+    {
+        crc = crc32_table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+static void zmodem_begin(bool escape_control)
+{
+    crc32_init();
+
+    for (int c = 0; c < 256; c++)
+    {
+        escape_table[c] = escape_control && ((c & 0x60) == 0);
+    }
+    escape_table[ZDLE] = true;
+    escape_table[0x10] = escape_table[0x90] = true;
+    escape_table[XON] = escape_table[XON | 0x80] = true;
+    escape_table[XOFF] = escape_table[XOFF | 0x80] = true;
+
+    tx_count = 0;
+    tx_last = 0;
+}
+
+static int zmodem_flush(void)
+{
+    int status = write_all(tx_buffer, tx_count);
+
+    tx_count = 0;
+
+    return status;
+}
+
+static void zmodem_put_raw(unsigned char c)
+{
+    if (tx_count == sizeof(tx_buffer))
+    {
+        zmodem_flush();
+    }
+    tx_buffer[tx_count++] = c;
+    tx_last = c;
+}
+
+/* Put ZDLE encoded byte, CR after @ is escaped as it could start telnet escape */
+static void zmodem_put(unsigned char c)
+{
+    if (escape_table[c] || (((c & 0x7f) == '\r') && ((tx_last & 0x7f) == '@')))
+    {
+        zmodem_put_raw(ZDLE);
+        c ^= 0x40;
+    }
+    zmodem_put_raw(c);
+}
+
+static void zmodem_put_hex(unsigned char c)
+{
+    static const char digits[] = "0123456789abcdef";
+
+    zmodem_put_raw(digits[c >> 4]);
+    zmodem_put_raw(digits[c & 0x0f]);
+}
+
+static void zmodem_position(unsigned char *header, uint32_t position)
+{
+    header[0] = position;
+    header[1] = position >> 8;
+    header[2] = position >> 16;
+    header[3] = position >> 24;
+}
+
+static uint32_t zmodem_header_position(const unsigned char *header)
+{
+    return header[0] | (header[1] << 8) | (header[2] << 16) | ((uint32_t) header[3] << 24);
+}
+
+/* Send header in hex, used by receiver and for headers not followed by data */
+static int zmodem_send_hex_header(int type, const unsigned char *header)
+{
+    unsigned char frame[5] = { type, header[0], header[1], header[2], header[3] };
+    uint16_t crc = crc16(frame, sizeof(frame));
+
+    zmodem_put_raw(ZPAD);
+    zmodem_put_raw(ZPAD);
+    zmodem_put_raw(ZDLE);
+    zmodem_put_raw(ZHEX);
+    for (size_t i = 0; i < sizeof(frame); i++)
+    {
+        zmodem_put_hex(frame[i]);
+    }
+    zmodem_put_hex(crc >> 8);
+    zmodem_put_hex(crc & 0xff);
+    zmodem_put_raw('\r');
+    zmodem_put_raw('\n' | 0x80);
+    if ((type != ZFIN) && (type != ZACK))
+    {
+        zmodem_put_raw(XON);
+    }
+
+    return zmodem_flush();
+}
+
+static int zmodem_send_hex_position(int type, uint32_t position)
+{
+    unsigned char header[4];
+
+    zmodem_position(header, position);
+
+    return zmodem_send_hex_header(type, header);
+}
+
+/* Queue binary header, used by sender for headers followed by data */
+static void zmodem_put_binary_header(int type, const unsigned char *header)
+{
+    unsigned char frame[5] = { type, header[0], header[1], header[2], header[3] };
+    uint32_t crc;
+
+    zmodem_put_raw(ZPAD);
+    zmodem_put_raw(ZDLE);
+    zmodem_put_raw(tx_crc32 ? ZBIN32 : ZBIN);
+    for (size_t i = 0; i < sizeof(frame); i++)
+    {
+        zmodem_put(frame[i]);
+    }
+
+    if (tx_crc32)
+    {
+        crc = ~crc32_update(0xffffffff, frame, sizeof(frame));
+        for (int i = 0; i < 4; i++)
+        {
+            zmodem_put(crc >> (8 * i));
+        }
+    }
+    else
+    {
+        crc = crc16(frame, sizeof(frame));
+        zmodem_put(crc >> 8);
+        zmodem_put(crc & 0xff);
+    }
+}
+
+/* Queue data subpacket ended by frame end type */
+static void zmodem_put_data(const unsigned char *data, size_t length, unsigned char end)
+{
+    uint32_t crc;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        zmodem_put(data[i]);
+    }
+    zmodem_put_raw(ZDLE);
+    zmodem_put_raw(end);
+
+    if (tx_crc32)
+    {
+        crc = ~crc32_update(crc32_update(0xffffffff, data, length), &end, 1);
+        for (int i = 0; i < 4; i++)
+        {
+            zmodem_put(crc >> (8 * i));
+        }
+    }
+    else
+    {
+        crc = crc16_update(crc16_update(0, data, length), &end, 1);
+        zmodem_put(crc >> 8);
+        zmodem_put(crc & 0xff);
+    }
+
+    if (end == ZCRCW)
+    {
+        zmodem_put_raw(XON);
+    }
+}
+
+/* Read ZDLE decoded byte, frame ends are returned or'ed with ZMODEM_FRAME_END */
+static int zmodem_read(int timeout)
+{
+    int cancels = 0;
+    int c;
+
+    while (true)
+    {
+        c = read_byte(timeout);
+        if (c < 0)
+        {
+            return ZMODEM_TIMEOUT;
+        }
+        if (c == ZDLE)
+        {
+            break;
+        }
+        if (((c & 0x7f) != XON) && ((c & 0x7f) != XOFF))
+        {
+            return c;
+        }
+    }
+
+    while (true)
+    {
+        c = read_byte(timeout);
+        if (c < 0)
+        {
+            return ZMODEM_TIMEOUT;
+        }
+
+        switch (c)
+        {
+            case ZDLE:
+                // Five CAN in a row cancel transfer
+                if (++cancels >= 4)
+                {
+                    return ZMODEM_CANCEL;
+                }
+                continue;
+            case ZCRCE:
+            case ZCRCG:
+            case ZCRCQ:
+            case ZCRCW:
+                return c | ZMODEM_FRAME_END;
+            case ZRUB0:
+                return 0x7f;
+            case ZRUB1:
+                return 0xff;
+            case XON:
+            case XON | 0x80:
+            case XOFF:
+            case XOFF | 0x80:
+                continue;
+            default:
+                if ((c & 0x60) == 0x40)
+                {
+                    return c ^ 0x40;
+                }
+                return ZMODEM_ERROR;
+        }
+    }
+}
+
+static int zmodem_read_hex(int timeout)
+{
+    int value = 0;
+    int c;
+
+    for (int i = 0; i < 2; i++)
+    {
+        c = read_byte(timeout);
+        if ((c >= '0') && (c <= '9'))
+        {
+            value = (value << 4) | (c - '0');
+        }
+        else if ((c >= 'a') && (c <= 'f'))
+        {
+            value = (value << 4) | (c - 'a' + 10);
+        }
+        else
+        {
+            return (c < 0) ? ZMODEM_TIMEOUT : ZMODEM_ERROR;
+        }
+    }
+
+    return value;
+}
+
+/* Wait for header, returns frame type or ZMODEM_TIMEOUT, ZMODEM_ERROR or ZMODEM_CANCEL */
+static int zmodem_read_header(unsigned char *header, int timeout)
+{
+    unsigned char frame[9];
+    size_t length;
+    int cancels = 0;
+    int kind;
+    int c;
+
+    /* Skip anything up to header start */
+    while (true)
+    {
+        c = read_byte(timeout);
+        if (c < 0)
+        {
+            return aborted ? ZMODEM_CANCEL : ZMODEM_TIMEOUT;
+        }
+        if (c == ZDLE)
+        {
+            if (++cancels >= 5)
+            {
+                return ZMODEM_CANCEL;
+            }
+            continue;
+        }
+        cancels = 0;
+        if (c != ZPAD)
+        {
+            continue;
+        }
+
+        do
+        {
+            c = read_byte(BYTE_TIMEOUT);
+        } while (c == ZPAD);
+        if (c != ZDLE)
+        {
+            continue;
+        }
+
+        kind = read_byte(BYTE_TIMEOUT);
+        if ((kind == ZBIN) || (kind == ZBIN32) || (kind == ZHEX))
+        {
+            break;
+        }
+    }
+
+    length = (kind == ZBIN32) ? 9 : 7;
+    for (size_t i = 0; i < length; i++)
+    {
+        c = (kind == ZHEX) ? zmodem_read_hex(BYTE_TIMEOUT) : zmodem_read(BYTE_TIMEOUT);
+        if ((c < 0) || (c & ZMODEM_FRAME_END))
+        {
+            return (c == ZMODEM_CANCEL) ? ZMODEM_CANCEL : ZMODEM_ERROR;
+        }
+        frame[i] = c;
+    }
+
+    if (kind == ZBIN32)
+    {
+        uint32_t crc = ~crc32_update(0xffffffff, frame, 5);
+        if ((frame[5] | (frame[6] << 8) | (frame[7] << 16) | ((uint32_t) frame[8] << 24)) != crc)
+        {
+            return ZMODEM_ERROR;
+        }
+    }
+    else if (crc16(frame, 7) != 0)
+    {
+        return ZMODEM_ERROR;
+    }
+
+    rx_crc32 = (kind == ZBIN32);
+    memcpy(header, frame + 1, 4);
+
+    return frame[0];
+}
+
+/* Read data subpacket following header, returns frame end type or error */
+static int zmodem_read_data(unsigned char *buffer, size_t size, size_t *length)
+{
+    unsigned char trailer[4];
+    unsigned char end;
+    uint32_t crc;
+    int c;
+
+    *length = 0;
+
+    while (true)
+    {
+        c = zmodem_read(BYTE_TIMEOUT);
+        if (c < 0)
+        {
+            return c;
+        }
+        if (c & ZMODEM_FRAME_END)
+        {
+            break;
+        }
+        if (*length == size)
+        {
+            return ZMODEM_ERROR;
+        }
+        buffer[(*length)++] = c;
+    }
+    end = c & 0xff;
+
+    for (int i = 0; i < (rx_crc32 ? 4 : 2); i++)
+    {
+        c = zmodem_read(BYTE_TIMEOUT);
+        if ((c < 0) || (c & ZMODEM_FRAME_END))
+        {
+            return (c == ZMODEM_CANCEL) ? ZMODEM_CANCEL : ZMODEM_ERROR;
+        }
+        trailer[i] = c;
+    }
+
+    if (rx_crc32)
+    {
+        crc = ~crc32_update(crc32_update(0xffffffff, buffer, *length), &end, 1);
+        if ((trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((uint32_t) trailer[3] << 24)) != crc)
+        {
+            return ZMODEM_ERROR;
+        }
+    }
+    else
+    {
+        crc = crc16_update(crc16_update(0, buffer, *length), &end, 1);
+        if ((uint32_t) ((trailer[0] << 8) | trailer[1]) != crc)
+        {
+            return ZMODEM_ERROR;
+        }
+    }
+
+    return end;
+}
+
+/* Returns true if receiver started sending a header, discarding anything else */
+static bool zmodem_header_pending(void)
+{
+    while (true)
+    {
+        if (rx_count == 0)
+        {
+            fill_input(0);
+        }
+        if (aborted)
+        {
+            return true;
+        }
+        if (rx_count == 0)
+        {
+            return false;
+        }
+        if ((rx_buffer[rx_start] == ZPAD) || (rx_buffer[rx_start] == ZDLE))
+        {
+            return true;
+        }
+        rx_start++;
+        rx_count--;
+    }
+}
+
+/* Wait for receiver to be ready, returns ZRINIT capabilities or -1 */
+static int zmodem_wait_receiver(unsigned char *header)
+{
+    unsigned char zero[4] = { 0 };
+
+    for (int request = 0; request * START_INTERVAL < START_TIMEOUT; request++)
+    {
+        switch (zmodem_read_header(header, START_INTERVAL))
+        {
+            case ZRINIT:
+                return header[ZF0];
+            case ZCHALLENGE:
+                zmodem_send_hex_header(ZACK, header);
+                break;
+            case ZCAN:
+            case ZABORT:
+            case ZMODEM_CANCEL:
+                return -1;
+            case ZMODEM_TIMEOUT:
+                if (aborted)
+                {
+                    return -1;
+                }
+                zmodem_send_hex_header(ZRQINIT, zero);
+                break;
+            default:
+                break;
+        }
+    }
+
+    tio_warning_printf("Timeout waiting for receiver");
+    return -1;
+}
+
+/* Send file information, returns position requested by receiver, -2 if skipped or -1 */
+static long long zmodem_send_file_header(const char *filename, const struct stat *st)
+{
+    unsigned char block[BLOCK_SIZE_1K];
+    unsigned char header[4] = { 0 };
+    size_t length;
+    char *name;
+
+    memset(block, 0, sizeof(block));
+    name = strdup(filename);
+    snprintf((char *) block, BLOCK_SIZE, "%s", basename(name));
+    free(name);
+    length = strlen((char *) block) + 1;
+    snprintf((char *) block + length, sizeof(block) - length, "%lld %llo %o 0 1 %lld",
+             (long long) st->st_size, (long long) st->st_mtime, (unsigned) st->st_mode,
+             (long long) st->st_size);
+    length += strlen((char *) block + length) + 1;
+
+    for (int retry = 0; retry < RETRY_MAX; retry++)
+    {
+        memset(header, 0, sizeof(header));
+        zmodem_put_binary_header(ZFILE, header);
+        zmodem_put_data(block, length, ZCRCW);
+        if (zmodem_flush() < 0)
+        {
+            return -1;
+        }
+
+        switch (zmodem_read_header(header, ACK_TIMEOUT))
+        {
+            case ZRPOS:
+                return zmodem_header_position(header);
+            case ZSKIP:
+                return -2;
+            case ZCAN:
+            case ZABORT:
+            case ZFERR:
+            case ZMODEM_CANCEL:
+                return -1;
+            default:
+                // ZRINIT, ZNAK, timeout or error, send again
+                break;
+        }
+
+        if (aborted)
+        {
+            return -1;
+        }
+    }
+
+    return -1;
+}
+
+static int zmodem_send_file(int file_fd, const char *filename, const struct stat *st)
+{
+    unsigned char block[ZMODEM_SUBPACKET];
+    unsigned char header[4];
+    uint32_t position, acked, next, request = 0;
+    uint32_t rxbuflen;
+    bool send_header = true;
+    long long start;
+    int errors = 0;
+    int flags;
+    ssize_t count;
+    unsigned char end;
+
+    zmodem_begin(false);
+    tx_crc32 = false;
+
+    /* Try to start receiver and send ZRQINIT */
+    write_all("rz\r", 3);
+    memset(header, 0, sizeof(header));
+    zmodem_send_hex_header(ZRQINIT, header);
+
+    flags = zmodem_wait_receiver(header);
+    if (flags < 0)
+    {
+        return -1;
+    }
+    rxbuflen = header[ZP0] | (header[ZP1] << 8);
+    tx_crc32 = flags & CANFC32;
+    zmodem_begin(flags & ESCCTL);
+
+    start = zmodem_send_file_header(filename, st);
+    if (start == -2)
+    {
+        tio_printf("File skipped by receiver");
+        goto finish;
+    }
+    if (start < 0)
+    {
+        return -1;
+    }
+
+    progress_start(st->st_size);
+    position = acked = start;
+
+    while (true)
+    {
+        if (send_header)
+        {
+            if (lseek(file_fd, position, SEEK_SET) < 0)
+            {
+                tio_warning_printf("Could not seek in file %s (%s)", filename, strerror(errno));
+                return -1;
+            }
+            zmodem_position(header, position);
+            zmodem_put_binary_header(ZDATA, header);
+            request = position;
+            send_header = false;
+        }
+
+        count = read(file_fd, block, sizeof(block));
+        if (count < 0)
+        {
+            tio_warning_printf("Could not read file %s (%s)", filename, strerror(errno));
+            return -1;
+        }
+
+        /* End frame at end of file, stop to wait where the receiver asks for it */
+        next = position + count;
+        if (count < (ssize_t) sizeof(block))
+        {
+            end = ZCRCE;
+        }
+        else if ((rxbuflen > 0) && (next - acked >= rxbuflen))
+        {
+            end = ZCRCW;
+        }
+        else if (next - request >= ZMODEM_WINDOW / 4)
+        {
+            end = ZCRCQ;
+            request = next;
+        }
+        else
+        {
+            end = ZCRCG;
+        }
+
+        zmodem_put_data(block, count, end);
+        if (zmodem_flush() < 0)
+        {
+            return -1;
+        }
+        position = next;
+        transfer_total = position;
+        progress_print("Sent", false);
+
+        if (end == ZCRCE)
+        {
+            zmodem_position(header, position);
+            zmodem_put_binary_header(ZEOF, header);
+            if (zmodem_flush() < 0)
+            {
+                return -1;
+            }
+        }
+
+        /* Handle acknowledgements and error reports, waiting for them when
+         * a window of data or a frame waiting for response is outstanding */
+        while ((end == ZCRCW) || (end == ZCRCE) || (position - acked > ZMODEM_WINDOW) ||
+               zmodem_header_pending())
+        {
+            int type = zmodem_read_header(header, ACK_TIMEOUT);
+
+            switch (type)
+            {
+                case ZACK:
+                    if ((zmodem_header_position(header) > acked) &&
+                        (zmodem_header_position(header) <= position))
+                    {
+                        acked = zmodem_header_position(header);
+                        errors = 0;
+                    }
+                    if (end == ZCRCW)
+                    {
+                        end = ZCRCG;
+                        send_header = true;
+                    }
+                    continue;
+
+                case ZRPOS:
+                    if (++errors > RETRY_MAX)
+                    {
+                        tio_warning_printf("Too many errors");
+                        return -1;
+                    }
+                    position = acked = zmodem_header_position(header);
+                    send_header = true;
+                    end = ZCRCG;
+                    break;
+
+                case ZRINIT:
+                    if (end == ZCRCE)
+                    {
+                        goto finish;
+                    }
+                    continue;
+
+                case ZSKIP:
+                    tio_printf("File skipped by receiver");
+                    goto finish;
+
+                case ZMODEM_TIMEOUT:
+                    if (aborted)
+                    {
+                        return -1;
+                    }
+                    /* Nothing heard, resume from what was acknowledged */
+                    if (++errors > RETRY_MAX)
+                    {
+                        tio_warning_printf("Timeout waiting for receiver");
+                        return -1;
+                    }
+                    position = acked;
+                    send_header = true;
+                    end = ZCRCG;
+                    break;
+
+                case ZCAN:
+                case ZABORT:
+                case ZFERR:
+                case ZMODEM_CANCEL:
+                    tio_warning_printf("Transfer cancelled by receiver");
+                    return -1;
+
+                default:
+                    continue;
+            }
+            break;
+        }
+    }
+
+finish:
+    /* End session */
+    for (int retry = 0; retry < RETRY_MAX; retry++)
+    {
+        memset(header, 0, sizeof(header));
+        zmodem_send_hex_header(ZFIN, header);
+        if (zmodem_read_header(header, START_INTERVAL) == ZFIN)
+        {
+            write_all("OO", 2);
+            return 0;
+        }
+        if (aborted)
+        {
+            return -1;
+        }
+    }
+
+    tio_warning_printf("End of session not acknowledged");
+    return -1;
+}
+
+/* Tell sender receiver is ready for file: full duplex, streaming without limit and CRC32 */
+static void zmodem_send_ready(void)
+{
+    unsigned char header[4] = { 0 };
+
+    header[ZF0] = CANFDX | CANOVIO | CANFC32;
+    zmodem_send_hex_header(ZRINIT, header);
+}
+
+/* Receive ZMODEM batch into directory, returns 0 on success */
+static int zmodem_receive_files(const char *path)
+{
+    unsigned char block[BLOCK_SIZE_1K + 1];
+    unsigned char header[4];
+    char filename[PATH_MAX];
+    uint32_t position = 0;
+    long long size = -1;
+    int file_fd = -1;
+    int errors = 0;
+    size_t length;
+    int type;
+    int end;
+
+    zmodem_begin(false);
+    zmodem_send_ready();
+
+    /* Wait longer for sender to start than for next data */
+    while (errors < ((file_fd < 0) ? START_TIMEOUT / START_INTERVAL : RETRY_MAX))
+    {
+        type = zmodem_read_header(header, (file_fd < 0) ? START_INTERVAL : ACK_TIMEOUT);
+
+        switch (type)
+        {
+            case ZRQINIT:
+                zmodem_send_ready();
+                break;
+
+            case ZEOF:
+                if (file_fd >= 0)
+                {
+                    if (zmodem_header_position(header) != position)
+                    {
+                        // End of file ahead of data received, data is underway
+                        break;
+                    }
+                    close(file_fd);
+                    file_fd = -1;
+                    progress_print("Received", true);
+                }
+                zmodem_send_ready();
+                break;
+
+            case ZSINIT:
+                // Attention string is not needed as tio never interrupts sender
+                if (zmodem_read_data(block, BLOCK_SIZE_1K, &length) < 0)
+                {
+                    errors++;
+                    zmodem_send_hex_position(ZNAK, 0);
+                    break;
+                }
+                zmodem_send_hex_position(ZACK, 1);
+                break;
+
+            case ZFILE:
+                if (zmodem_read_data(block, BLOCK_SIZE_1K, &length) < 0)
+                {
+                    errors++;
+                    zmodem_send_hex_position(ZNAK, 0);
+                    break;
+                }
+                if (file_fd >= 0)
+                {
+                    // File header sent again
+                    zmodem_send_hex_position(ZRPOS, position);
+                    break;
+                }
+                block[length] = 0;
+                size = -1;
+                sscanf((char *) block + strnlen((char *) block, length) + 1, "%lld", &size);
+
+                file_fd = open_received(path, (char *) block, filename, sizeof(filename));
+                if (file_fd < 0)
+                {
+                    return -1;
+                }
+                tio_printf("Receiving file %s (%lld bytes)", filename, size);
+                position = 0;
+                progress_start((size > 0) ? size : 0);
+                zmodem_send_hex_position(ZRPOS, position);
+                break;
+
+            case ZDATA:
+                if (file_fd < 0)
+                {
+                    errors++;
+                    break;
+                }
+                if (zmodem_header_position(header) != position)
+                {
+                    // Data from before last error, ask again for what comes next
+                    errors++;
+                    zmodem_send_hex_position(ZRPOS, position);
+                    break;
+                }
+
+                /* Take subpackets until frame ends */
+                do
+                {
+                    end = zmodem_read_data(block, BLOCK_SIZE_1K, &length);
+                    if (end < 0)
+                    {
+                        break;
+                    }
+                    if (write(file_fd, block, length) != (ssize_t) length)
+                    {
+                        tio_warning_printf("Could not write file (%s)", strerror(errno));
+                        zmodem_send_hex_position(ZFERR, 0);
+                        close(file_fd);
+                        return -1;
+                    }
+                    position += length;
+                    transfer_total = position;
+                    errors = 0;
+                    progress_print("Received", false);
+
+                    if ((end == ZCRCW) || (end == ZCRCQ))
+                    {
+                        zmodem_send_hex_position(ZACK, position);
+                    }
+                } while ((end == ZCRCG) || (end == ZCRCQ));
+
+                if (end == ZMODEM_CANCEL)
+                {
+                    tio_warning_printf("Transfer cancelled by sender");
+                    close(file_fd);
+                    return -1;
+                }
+                if (end < 0)
+                {
+                    if (aborted)
+                    {
+                        cancel();
+                        close(file_fd);
+                        return -1;
+                    }
+                    errors++;
+                    zmodem_send_hex_position(ZRPOS, position);
+                }
+                break;
+
+            case ZFIN:
+                if (file_fd >= 0)
+                {
+                    close(file_fd);
+                    tio_warning_printf("Session ended before end of file");
+                    return -1;
+                }
+                memset(header, 0, sizeof(header));
+                zmodem_send_hex_header(ZFIN, header);
+                // Sender closes session with "OO"
+                read_byte(BYTE_TIMEOUT);
+                read_byte(BYTE_TIMEOUT);
+                return 0;
+
+            case ZCAN:
+            case ZABORT:
+            case ZMODEM_CANCEL:
+                if (aborted)
+                {
+                    cancel();
+                }
+                else
+                {
+                    tio_warning_printf("Transfer cancelled by sender");
+                }
+                if (file_fd >= 0)
+                {
+                    close(file_fd);
+                }
+                return -1;
+
+            case ZMODEM_TIMEOUT:
+                errors++;
+                if (file_fd >= 0)
+                {
+                    zmodem_send_hex_position(ZRPOS, position);
+                }
+                else
+                {
+                    zmodem_send_ready();
+                }
+                break;
+
+            case ZMODEM_ERROR:
+                errors++;
+                if (file_fd >= 0)
+                {
+                    zmodem_send_hex_position(ZRPOS, position);
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    if (file_fd >= 0)
+    {
+        close(file_fd);
+    }
+    tio_warning_printf("Too many errors");
+    cancel();
+    return -1;
+}
+
+static void transfer_begin(int fd, int abort_fd)
+{
+    tty_fd = fd;
+    input_fd = abort_fd;
+    rx_start = rx_count = 0;
+    aborted = false;
+}
+
+int xymodem_send(int fd, int abort_fd, const char *filename, enum xymodem_mode_t mode)
+{
+    unsigned char block[BLOCK_SIZE_1K];
+    unsigned char number = 1;
+    struct stat st;
+    size_t length;
+    ssize_t count;
+    int file_fd;
+    int request;
+    bool crc;
+
+    transfer_begin(fd, abort_fd);
+
+    file_fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0)
+    {
+        tio_warning_printf("Could not open file %s (%s)", filename, strerror(errno));
+        return -1;
+    }
+    fstat(file_fd, &st);
+
+    tio_printf("Sending file %s (%lld bytes) via %s, press ESC to abort", filename,
+               (long long) st.st_size, xymodem_mode_to_string(mode));
+    tio_printf("Waiting for receiver..");
+    print_buffer_flush();
+
+    if (mode == ZMODEM)
+    {
+        if (zmodem_send_file(file_fd, filename, &st) < 0)
+        {
+            goto error;
+        }
+        goto done;
+    }
+
+    request = wait_request();
+    if (request < 0)
+    {
+        goto error;
+    }
+    crc = (request == CRC);
+
+    if (mode == YMODEM)
+    {
+        if (!crc)
+        {
+            tio_warning_printf("Receiver does not support YMODEM");
+            goto error;
+        }
+        if ((send_header(filename, &st) < 0) || (wait_request() != CRC))
+        {
+            goto error;
+        }
+    }
+
+    progress_start(st.st_size);
+
+    while (true)
+    {
+        /* Use 1K blocks where supported unless less than a small block is left */
+        length = ((mode != XMODEM_CRC) && crc && ((st.st_size - transfer_total) > BLOCK_SIZE)) ?
+                 BLOCK_SIZE_1K : BLOCK_SIZE;
+
+        count = read(file_fd, block, length);
+        if (count < 0)
+        {
+            tio_warning_printf("Could not read file %s (%s)", filename, strerror(errno));
+            goto error;
+        }
+        if (count == 0)
+        {
+            break;
+        }
+
+        // Pad last block
+        memset(block + count, SUB, length - count);
+
+        if (send_block(number++, block, length, crc) < 0)
+        {
+            goto error;
+        }
+
+        transfer_total += count;
+        progress_print("Sent", false);
+    }
+
+    if (send_eot() < 0)
+    {
+        goto error;
+    }
+
+    if (mode == YMODEM)
+    {
+        /* End batch with empty block 0 */
+        if ((wait_request() != CRC) || (send_header(NULL, NULL) < 0))
+        {
+            goto error;
+        }
+    }
+
+done:
+    close(file_fd);
+    progress_print("Sent", true);
+    tio_printf("File transfer completed");
+
+    return 0;
+
+error:
+    close(file_fd);
+    cancel();
+    tio_warning_printf("File transfer failed");
+
+    return -1;
+}
+
+/* Read block following block start character */
+static enum packet_t read_block(int start, unsigned char *block, size_t *length, unsigned char *number, bool crc)
+{
+    uint16_t crc16_value;
+    int c, n, inverse;
+
+    *length = (start == STX) ? BLOCK_SIZE_1K : BLOCK_SIZE;
+
+    n = read_byte(BYTE_TIMEOUT);
+    inverse = read_byte(BYTE_TIMEOUT);
+    if ((n < 0) || (inverse < 0) || ((n ^ inverse) != 0xff))
+    {
+        return aborted ? PACKET_ABORT : PACKET_ERROR;
+    }
+    *number = n;
+
+    for (size_t i = 0; i < *length; i++)
+    {
+        c = read_byte(BYTE_TIMEOUT);
+        if (c < 0)
+        {
+            return aborted ? PACKET_ABORT : PACKET_ERROR;
+        }
+        block[i] = c;
+    }
+
+    if (crc)
+    {
+        c = read_byte(BYTE_TIMEOUT);
+        n = read_byte(BYTE_TIMEOUT);
+        if ((c < 0) || (n < 0))
+        {
+            return aborted ? PACKET_ABORT : PACKET_ERROR;
+        }
+        crc16_value = (c << 8) | n;
+        if (crc16_value != crc16(block, *length))
+        {
+            return PACKET_ERROR;
+        }
+    }
+    else
+    {
+        c = read_byte(BYTE_TIMEOUT);
+        if ((c < 0) || (c != checksum(block, *length)))
+        {
+            return aborted ? PACKET_ABORT : PACKET_ERROR;
+        }
+    }
+
+    return PACKET_DATA;
+}
+
+static enum packet_t read_packet(unsigned char *block, size_t *length, unsigned char *number, bool crc, int timeout)
+{
+    int c;
+
+    while (true)
+    {
+        c = read_byte(timeout);
+        switch (c)
+        {
+            case SOH:
+            case STX:
+                return read_block(c, block, length, number, crc);
+            case EOT:
+                return PACKET_EOT;
+            case CAN:
+                if (read_byte(BYTE_TIMEOUT) == CAN)
+                {
+                    return PACKET_CANCEL;
+                }
+                break;
+            case -1:
+                return aborted ? PACKET_ABORT : PACKET_TIMEOUT;
+            default:
+                // Ignore line noise between blocks
+                break;
+        }
+    }
+}
+
+/* Receive blocks until end of file, size is -1 if unknown. Returns 0 on success. */
+static int receive_data(int file_fd, long long size, bool checksum_fallback)
+{
+    unsigned char block[BLOCK_SIZE_1K];
+    unsigned char expected = 1;
+    unsigned char number;
+    size_t length, count;
+    bool started = false;
+    int errors = 0;
+    int requests = 0;
+    bool crc = true;
+
+    progress_start((size > 0) ? size : 0);
+
+    write_byte(CRC);
+
+    while (errors < RETRY_MAX)
+    {
+        switch (read_packet(block, &length, &number, crc, started ? ACK_TIMEOUT : START_INTERVAL))
+        {
+            case PACKET_DATA:
+                started = true;
+                if (number == expected)
+                {
+                    count = length;
+                    if (size >= 0)
+                    {
+                        // Strip padding of last block when file size is known
+                        count = MIN((long long) length, size - (long long) transfer_total);
+                    }
+                    if (write(file_fd, block, count) != (ssize_t) count)
+                    {
+                        tio_warning_printf("Could not write file (%s)", strerror(errno));
+                        cancel();
+                        return -1;
+                    }
+                    transfer_total += count;
+                    expected++;
+                    errors = 0;
+                    progress_print("Received", false);
+                }
+                else if (number != (unsigned char) (expected - 1))
+                {
+                    // Neither expected nor repeated block, sender is out of sync
+                    tio_warning_printf("Unexpected block %u, expected %u", number, expected);
+                    cancel();
+                    return -1;
+                }
+                write_byte(ACK);
+                break;
+
+            case PACKET_EOT:
+                write_byte(ACK);
+                progress_print("Received", true);
+                return 0;
+
+            case PACKET_CANCEL:
+                tio_warning_printf("Transfer cancelled by sender");
+                return -1;
+
+            case PACKET_ABORT:
+                cancel();
+                return -1;
+
+            case PACKET_TIMEOUT:
+                if (!started)
+                {
+                    /* Fall back to checksum mode if sender does not respond to CRC requests */
+                    if ((++requests == 4) && checksum_fallback)
+                    {
+                        crc = false;
+                    }
+                    if (requests * START_INTERVAL >= START_TIMEOUT)
+                    {
+                        tio_warning_printf("Timeout waiting for sender");
+                        cancel();
+                        return -1;
+                    }
+                    write_byte(crc ? CRC : NAK);
+                    break;
+                }
+                errors++;
+                write_byte(NAK);
+                break;
+
+            case PACKET_ERROR:
+                errors++;
+                purge_input();
+                write_byte(NAK);
+                break;
+        }
+    }
+
+    tio_warning_printf("Too many errors");
+    cancel();
+    return -1;
+}
+
+/* Receive YMODEM block 0, returns 1 for file header, 0 at end of batch */
+static int receive_header(char *name, size_t name_size, long long *size)
+{
+    unsigned char block[BLOCK_SIZE_1K + 1];
+    unsigned char number;
+    size_t length;
+    int errors = 0;
+
+    write_byte(CRC);
+
+    while (errors < RETRY_MAX)
+    {
+        switch (read_packet(block, &length, &number, true, START_INTERVAL))
+        {
+            case PACKET_DATA:
+                if (number != 0)
+                {
+                    // Sender still sending data of previous file
+                    write_byte(ACK);
+                    break;
+                }
+                block[length] = 0;
+                if (block[0] == 0)
+                {
+                    write_byte(ACK);
+                    return 0;
+                }
+                snprintf(name, name_size, "%s", (char *) block);
+                *size = -1;
+                sscanf((char *) block + strlen((char *) block) + 1, "%lld", size);
+                write_byte(ACK);
+                return 1;
+
+            case PACKET_CANCEL:
+                tio_warning_printf("Transfer cancelled by sender");
+                return -1;
+
+            case PACKET_ABORT:
+                cancel();
+                return -1;
+
+            case PACKET_EOT:
+                // Repeated EOT of previous file
+                write_byte(ACK);
+                break;
+
+            case PACKET_TIMEOUT:
+            case PACKET_ERROR:
+                errors++;
+                purge_input();
+                write_byte(CRC);
+                break;
+        }
+    }
+
+    tio_warning_printf("Timeout waiting for sender");
+    cancel();
+    return -1;
+}
+
+int xymodem_receive(int fd, int abort_fd, const char *path, enum xymodem_mode_t mode)
+{
+    char name[BLOCK_SIZE_1K + 1];
+    char filename[PATH_MAX];
+    long long size;
+    int file_fd;
+    int status;
+
+    transfer_begin(fd, abort_fd);
+
+    tio_printf("Receiving via %s, press ESC to abort", xymodem_mode_to_string(mode));
+    tio_printf("Waiting for sender..");
+    print_buffer_flush();
+
+    if (mode == ZMODEM)
+    {
+        status = zmodem_receive_files(path);
+    }
+    else if (mode != YMODEM)
+    {
+        file_fd = open_output(path);
+        if (file_fd < 0)
+        {
+            return -1;
+        }
+        status = receive_data(file_fd, -1, true);
+        close(file_fd);
+    }
+    else
+    {
+        /* Receive batch of files into directory */
+        while ((status = receive_header(name, sizeof(name), &size)) > 0)
+        {
+            file_fd = open_received(path, name, filename, sizeof(filename));
+            if (file_fd < 0)
+            {
+                status = -1;
+                break;
+            }
+            tio_printf("Receiving file %s (%lld bytes)", filename, size);
+            status = receive_data(file_fd, size, false);
+            close(file_fd);
+            if (status < 0)
+            {
+                break;
+            }
+        }
+    }
+
+    if (status < 0)
+    {
+        tio_warning_printf("File transfer failed");
+        return -1;
+    }
+
+    tio_printf("File transfer completed");
+
+    return 0;
+}
+
+enum xymodem_mode_t xymodem_option_parse(const char *arg)
+{
+    if (strcmp(arg, "xmodem") == 0)
+    {
+        return XMODEM_CRC;
+    }
+    else if (strcmp(arg, "xmodem-1k") == 0)
+    {
+        return XMODEM_1K;
+    }
+    else if (strcmp(arg, "ymodem") == 0)
+    {
+        return YMODEM;
+    }
+    else if (strcmp(arg, "zmodem") == 0)
+    {
+        return ZMODEM;
+    }
+
+    tio_error_printf("Invalid transfer protocol '%s'", arg);
+    exit(EXIT_FAILURE);
+}
+
+const char *xymodem_mode_to_string(enum xymodem_mode_t mode)
+{
+    switch (mode)
+    {
+        case XMODEM_CRC:
+            return "xmodem";
+        case XMODEM_1K:
+            return "xmodem-1k";
+        case YMODEM:
+            return "ymodem";
+        case ZMODEM:
+            return "zmodem";
+        default:
+            return "unknown";
+    }
+}
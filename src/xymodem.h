@@ -0,0 +1,35 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#pragma once
+
+enum xymodem_mode_t
+{
+    XMODEM_CRC,
+    XMODEM_1K,
+    YMODEM,
+    ZMODEM,
+};
+
+int xymodem_send(int fd, int abort_fd, const char *filename, enum xymodem_mode_t mode);
+int xymodem_receive(int fd, int abort_fd, const char *path, enum xymodem_mode_t mode);
+enum xymodem_mode_t xymodem_option_parse(const char *arg);
+const char *xymodem_mode_to_string(enum xymodem_mode_t mode);
@@ -0,0 +1,78 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Minimal stand-ins for the parts of tio the unit tests do not link in.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include "options.h"
+#include "timestamp.h"
+#include "error.h"
+#include "uring.h"
+#include "tty.h"
+
+struct option_t option;
+
+char *timestamp_current_time(void)
+{
+    static char time_string[] = "00:00:00.000";
+
+    return time_string;
+}
+
+void tio_error_printf(const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+bool uring_enabled(void)
+{
+    return false;
+}
+
+void uring_write(int fd, const void *buffer, size_t count, void (*error)(int fd))
+{
+    (void) fd;
+    (void) buffer;
+    (void) count;
+    (void) error;
+}
+
+void uring_wait(int fd)
+{
+    (void) fd;
+}
+
+void forward_buffer_to_tty(int fd, const char *buffer, size_t count)
+{
+    (void) fd;
+    (void) buffer;
+    (void) count;
+}
@@ -0,0 +1,127 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Check the hexdump layout against a row formatted with printf, for the
+ * same data fed in chunks of various sizes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "options.h"
+#include "print.h"
+
+#define DATA_SIZE 100
+#define OUTPUT_MAX 4096
+
+static char expected[OUTPUT_MAX];
+static size_t expected_length = 0;
+
+static void expect_row(unsigned long offset, const unsigned char *row, size_t count)
+{
+    char *p = expected + expected_length;
+    size_t i;
+
+    p += sprintf(p, "%08lx: ", offset);
+    for (i = 0; i < 16; i++)
+    {
+        if (i < count)
+        {
+            p += sprintf(p, "%02x", row[i]);
+        }
+        else
+        {
+            p += sprintf(p, "  ");
+        }
+        if (i & 1)
+        {
+            *p++ = ' ';
+        }
+    }
+    *p++ = ' ';
+    for (i = 0; i < count; i++)
+    {
+        *p++ = ((row[i] >= 0x20) && (row[i] < 0x7f)) ? row[i] : '.';
+    }
+    *p++ = '\r';
+    *p++ = '\n';
+
+    expected_length = p - expected;
+}
+
+int main(void)
+{
+    static const size_t chunks[] = { 1, 3, 15, 16, 17, 33, DATA_SIZE };
+    unsigned char data[DATA_SIZE];
+    char output[OUTPUT_MAX];
+    FILE *file;
+    size_t i, j, count, length;
+    int failures = 0;
+
+    for (i = 0; i < DATA_SIZE; i++)
+    {
+        data[i] = i * 13 + 5;
+    }
+    for (i = 0; i < DATA_SIZE; i += 16)
+    {
+        expect_row(i, data + i, (DATA_SIZE - i < 16) ? DATA_SIZE - i : 16);
+    }
+
+    /* Capture output written to stdout */
+    file = tmpfile();
+    if ((file == NULL) || (dup2(fileno(file), STDOUT_FILENO) < 0))
+    {
+        perror("tmpfile");
+        return EXIT_FAILURE;
+    }
+
+    print_buffer_init();
+
+    for (i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++)
+    {
+        if (ftruncate(STDOUT_FILENO, 0) < 0)
+        {
+            perror("ftruncate");
+            return EXIT_FAILURE;
+        }
+        lseek(STDOUT_FILENO, 0, SEEK_SET);
+
+        for (j = 0; j < DATA_SIZE; j += count)
+        {
+            count = (DATA_SIZE - j < chunks[i]) ? DATA_SIZE - j : chunks[i];
+            print_buffer_hexdump((const char *) data + j, count);
+        }
+        print_hexdump_reset();
+        print_buffer_flush();
+
+        length = pread(STDOUT_FILENO, output, sizeof(output), 0);
+        if ((length != expected_length) || (memcmp(output, expected, length) != 0))
+        {
+            fprintf(stderr, "Chunks of %zu bytes: got\n%.*s\nexpected\n%.*s\n",
+                    chunks[i], (int) length, output, (int) expected_length, expected);
+            failures++;
+        }
+    }
+
+    return (failures > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
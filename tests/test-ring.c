@@ -0,0 +1,177 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Check ring buffer space accounting across wraparound, then stream a byte
+ * sequence from a producer thread to the consumer and verify it arrives
+ * complete and in order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "ring.h"
+
+#define RING_SIZE 1000          // Rounded up to 1024
+#define STREAM_SIZE (64 * 1024 * 1024)
+
+#define CHECK(condition) \
+    if (!(condition)) \
+    { \
+        fprintf(stderr, "%s:%d: Check failed: %s\n", __FILE__, __LINE__, #condition); \
+        return -1; \
+    }
+
+static struct ring_t ring;
+
+static int check_wraparound(void)
+{
+    char *pointer, *start;
+    size_t space;
+
+    CHECK(ring_init(&ring, RING_SIZE) == 0);
+    CHECK(ring.size == 1024);
+    start = ring.buffer;
+
+    CHECK(ring_read_space(&ring, &pointer) == 0);
+    CHECK(ring_write_space(&ring, &pointer) == 1024);
+    CHECK(pointer == start);
+
+    /* First commit to an empty ring asks for a consumer wakeup */
+    CHECK(ring_commit(&ring, 1000) == true);
+    CHECK(ring_commit(&ring, 0) == false);
+    CHECK(ring_write_space(&ring, &pointer) == 24);
+    CHECK(pointer == start + 1000);
+
+    CHECK(ring_read_space(&ring, &pointer) == 1000);
+    CHECK(pointer == start);
+    ring_release(&ring, 900);
+
+    /* Free space wraps, only the part up to the end is contiguous */
+    CHECK(ring_write_space(&ring, &pointer) == 24);
+    CHECK(ring_commit(&ring, 24) == false);
+    space = ring_write_space(&ring, &pointer);
+    CHECK(space == 900);
+    CHECK(pointer == start);
+    CHECK(ring_commit(&ring, 900) == false);
+    CHECK(ring_write_space(&ring, &pointer) == 0);
+
+    /* Data wraps likewise */
+    CHECK(ring_read_space(&ring, &pointer) == 124);
+    CHECK(pointer == start + 900);
+    ring_release(&ring, 124);
+    CHECK(ring_read_space(&ring, &pointer) == 900);
+    CHECK(pointer == start);
+    ring_release(&ring, 900);
+    CHECK(ring_read_space(&ring, &pointer) == 0);
+    CHECK(ring.high_water == 1024);
+
+    ring_free(&ring);
+
+    return 0;
+}
+
+static void *producer(void *arg)
+{
+    size_t written = 0, space, count;
+    char *pointer;
+
+    (void) arg;
+
+    while (written < STREAM_SIZE)
+    {
+        space = ring_write_space(&ring, &pointer);
+        if (space == 0)
+        {
+            sched_yield();
+            continue;
+        }
+
+        /* Vary commit sizes so chunk boundaries move around the ring */
+        count = (written % 251) + 1;
+        if (count > space)
+        {
+            count = space;
+        }
+        if (count > STREAM_SIZE - written)
+        {
+            count = STREAM_SIZE - written;
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            pointer[i] = (char) ((written + i) % 253);
+        }
+        ring_commit(&ring, count);
+        written += count;
+    }
+
+    return NULL;
+}
+
+static int check_stream(void)
+{
+    pthread_t thread;
+    size_t received = 0, count;
+    char *pointer;
+
+    CHECK(ring_init(&ring, RING_SIZE) == 0);
+    CHECK(pthread_create(&thread, NULL, producer, NULL) == 0);
+
+    while (received < STREAM_SIZE)
+    {
+        count = ring_read_space(&ring, &pointer);
+        if (count == 0)
+        {
+            sched_yield();
+            continue;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            if (pointer[i] != (char) ((received + i) % 253))
+            {
+                fprintf(stderr, "Byte %zu corrupted\n", received + i);
+                pthread_cancel(thread);
+                return -1;
+            }
+        }
+        ring_release(&ring, count);
+        received += count;
+    }
+
+    pthread_join(thread, NULL);
+    CHECK(ring_read_space(&ring, &pointer) == 0);
+    ring_free(&ring);
+
+    return 0;
+}
+
+int main(void)
+{
+    if ((check_wraparound() < 0) || (check_stream() < 0))
+    {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,136 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Check the multi-pattern matching automaton of expect steps against a
+ * naive search, using random patterns and text over a small alphabet so
+ * overlapping and nested patterns are common.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "script.c"
+
+#define ROUNDS 2000
+#define PATTERNS_MAX 8
+#define PATTERN_LENGTH_MAX 6
+#define TEXT_LENGTH 200
+
+static const char alphabet[] = { 'a', 'b', '\0', (char) 0xff };
+
+/* First pattern to complete, the longest one if several end at once */
+static int match_reference(struct token_t *patterns, int count, const char *text, size_t length, size_t *end)
+{
+    int best;
+
+    for (*end = 1; *end <= length; (*end)++)
+    {
+        best = -1;
+        for (int i = 0; i < count; i++)
+        {
+            if ((patterns[i].length <= *end) &&
+                (memcmp(text + *end - patterns[i].length, patterns[i].text, patterns[i].length) == 0) &&
+                ((best < 0) || (patterns[i].length > patterns[best].length)))
+            {
+                best = i;
+            }
+        }
+        if (best >= 0)
+        {
+            return best;
+        }
+    }
+
+    return -1;
+}
+
+static int match_automaton(struct automaton_t *a, const char *text, size_t length, size_t *end)
+{
+    int s = 0;
+
+    for (*end = 1; *end <= length; (*end)++)
+    {
+        s = a->next[s][(unsigned char) text[*end - 1]];
+        if (a->match[s] >= 0)
+        {
+            return a->match[s];
+        }
+    }
+
+    return -1;
+}
+
+int main(void)
+{
+    char storage[PATTERNS_MAX][PATTERN_LENGTH_MAX];
+    struct token_t patterns[PATTERNS_MAX];
+    struct automaton_t a;
+    char text[TEXT_LENGTH];
+    size_t expected_end, end;
+    int count, expected, result;
+
+    srand(1);
+
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        count = rand() % PATTERNS_MAX + 1;
+        for (int i = 0; i < count; i++)
+        {
+            patterns[i].text = storage[i];
+            patterns[i].length = rand() % PATTERN_LENGTH_MAX + 1;
+            patterns[i].quoted = true;
+            for (size_t j = 0; j < patterns[i].length; j++)
+            {
+                storage[i][j] = alphabet[rand() % sizeof(alphabet)];
+            }
+        }
+        for (size_t j = 0; j < sizeof(text); j++)
+        {
+            text[j] = alphabet[rand() % sizeof(alphabet)];
+        }
+
+        automaton_build(&a, patterns, count);
+
+        expected = match_reference(patterns, count, text, sizeof(text), &expected_end);
+        result = match_automaton(&a, text, sizeof(text), &end);
+
+        /* Duplicate patterns are reported as the first one */
+        if ((result >= 0) && (expected >= 0) &&
+            (patterns[result].length == patterns[expected].length) &&
+            (memcmp(patterns[result].text, patterns[expected].text, patterns[result].length) == 0))
+        {
+            expected = result;
+        }
+
+        if ((result != expected) || ((result >= 0) && (end != expected_end)))
+        {
+            fprintf(stderr, "Round %d: matched pattern %d at %zu, expected %d at %zu\n",
+                    round, result, end, expected, expected_end);
+            return EXIT_FAILURE;
+        }
+
+        free(a.next);
+        free(a.match);
+    }
+
+    return EXIT_SUCCESS;
+}
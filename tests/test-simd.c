@@ -0,0 +1,164 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Check the vectorized RX buffer kernels against their scalar versions for
+ * all lengths and alignments around the vector widths, and bit reversal
+ * against a bit by bit reference.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "simd.c"
+
+#define MAX_LENGTH 200
+#define MAX_OFFSET 64
+
+static char buffer[MAX_OFFSET + MAX_LENGTH];
+static int failures = 0;
+
+static size_t find_eol_reference(const char *data, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        if ((data[i] == '\n') || (data[i] == '\r'))
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+static void check_find_eol(const char *name, size_t (*function)(const char *, size_t))
+{
+    const char eol[] = { '\n', '\r' };
+    size_t offset, length, position, expected, result;
+
+    for (offset = 0; offset < MAX_OFFSET; offset++)
+    {
+        for (length = 0; length <= MAX_LENGTH; length++)
+        {
+            /* Line boundary at each position, plus none at all */
+            for (position = 0; position <= length; position++)
+            {
+                char *data = buffer + offset;
+
+                /* Bytes equal to NL and CR apart from the top bit must not match */
+                for (size_t i = 0; i < length; i++)
+                {
+                    data[i] = (i & 1) ? (char) 0x8a : (char) 0x8d;
+                }
+                if (position < length)
+                {
+                    data[position] = eol[position & 1];
+                    if (position + 1 < length)
+                    {
+                        data[length - 1] = eol[~position & 1];
+                    }
+                }
+
+                expected = find_eol_reference(data, length);
+                result = function(data, length);
+                if (result != expected)
+                {
+                    fprintf(stderr, "%s: offset %zu length %zu: got %zu, expected %zu\n",
+                            name, offset, length, result, expected);
+                    failures++;
+                    return;
+                }
+            }
+        }
+    }
+}
+
+static void check_reverse_bits(const char *name, void (*function)(char *, size_t))
+{
+    size_t offset, length;
+    unsigned char c, expected;
+
+    for (offset = 0; offset < MAX_OFFSET; offset++)
+    {
+        for (length = 0; length <= MAX_LENGTH; length++)
+        {
+            char *data = buffer + offset;
+
+            for (size_t i = 0; i < length; i++)
+            {
+                data[i] = (char) (i * 7 + offset + length);
+            }
+
+            function(data, length);
+
+            for (size_t i = 0; i < length; i++)
+            {
+                c = (unsigned char) (i * 7 + offset + length);
+                expected = 0;
+                for (int bit = 0; bit < 8; bit++)
+                {
+                    expected |= ((c >> bit) & 1) << (7 - bit);
+                }
+                if ((unsigned char) data[i] != expected)
+                {
+                    fprintf(stderr, "%s: offset %zu length %zu: byte %zu is %02x, expected %02x\n",
+                            name, offset, length, i, (unsigned char) data[i], expected);
+                    failures++;
+                    return;
+                }
+            }
+        }
+    }
+}
+
+int main(void)
+{
+    check_find_eol("find_eol_scalar", find_eol_scalar);
+#ifdef HAVE_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+    {
+        check_find_eol("find_eol_sse2", find_eol_sse2);
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        check_find_eol("find_eol_avx2", find_eol_avx2);
+    }
+#endif
+    check_find_eol("simd_find_eol", simd_find_eol);
+
+    check_reverse_bits("reverse_bits_scalar", reverse_bits_scalar);
+#ifdef HAVE_SIMD_X86
+    if (__builtin_cpu_supports("ssse3"))
+    {
+        check_reverse_bits("reverse_bits_ssse3", reverse_bits_ssse3);
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        check_reverse_bits("reverse_bits_avx2", reverse_bits_avx2);
+    }
+#endif
+    check_reverse_bits("simd_reverse_bits", simd_reverse_bits);
+
+    return (failures > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,201 @@
+/*
+ * tio - a simple serial terminal I/O tool
+ *
+ * Copyright (c) 2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Check the CRCs against their standard check values and pass XMODEM
+ * blocks and ZMODEM frames through a socket pair to the receive side.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "xymodem.c"
+
+#define CHECK(condition) \
+    if (!(condition)) \
+    { \
+        fprintf(stderr, "%s:%d: Check failed: %s\n", __FILE__, __LINE__, #condition); \
+        return -1; \
+    }
+
+static const unsigned char check_input[] = "123456789";
+static int sv[2];
+static unsigned char wire[4 * BLOCK_SIZE_1K];
+
+/* Collect what was sent on sv[0] as it arrives on sv[1] */
+static size_t wire_read(void)
+{
+    struct pollfd pfd = { .fd = sv[1], .events = POLLIN };
+    size_t length = 0;
+    ssize_t count;
+
+    while ((length < sizeof(wire)) && (poll(&pfd, 1, 100) > 0))
+    {
+        count = read(sv[1], wire + length, sizeof(wire) - length);
+        if (count <= 0)
+        {
+            break;
+        }
+        length += count;
+    }
+
+    return length;
+}
+
+/* Feed bytes to the receive side reading sv[0] */
+static void wire_write(const unsigned char *data, size_t length)
+{
+    if (write(sv[1], data, length) != (ssize_t) length)
+    {
+        perror("write");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static int check_crc(void)
+{
+    crc32_init();
+
+    CHECK(crc16(check_input, 9) == 0x31c3);
+    CHECK(crc16_update(crc16(check_input, 4), check_input + 4, 5) == 0x31c3);
+    CHECK((~crc32_update(0xffffffff, check_input, 9)) == 0xcbf43926);
+    CHECK(checksum(check_input, 9) == 0xdd);
+
+    return 0;
+}
+
+static int check_block(size_t length, bool crc)
+{
+    unsigned char data[BLOCK_SIZE_1K], block[BLOCK_SIZE_1K];
+    unsigned char ack = ACK, number;
+    size_t size, received;
+    uint16_t crc16_value;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        data[i] = i * 31 + 7;
+    }
+
+    /* Block goes out framed and numbered once acknowledged */
+    transfer_begin(sv[0], -1);
+    wire_write(&ack, 1);
+    CHECK(send_block(3, data, length, crc) == 0);
+
+    size = wire_read();
+    CHECK(size == length + (crc ? 5 : 4));
+    CHECK(wire[0] == ((length == BLOCK_SIZE_1K) ? STX : SOH));
+    CHECK((wire[1] == 3) && (wire[2] == 0xfc));
+    CHECK(memcmp(wire + 3, data, length) == 0);
+    if (crc)
+    {
+        crc16_value = crc16(data, length);
+        CHECK((wire[length + 3] == (crc16_value >> 8)) && (wire[length + 4] == (crc16_value & 0xff)));
+    }
+    else
+    {
+        CHECK(wire[length + 3] == checksum(data, length));
+    }
+
+    /* Same bytes are accepted by the receive side */
+    transfer_begin(sv[0], -1);
+    wire_write(wire, size);
+    CHECK(read_packet(block, &received, &number, crc, 1000) == PACKET_DATA);
+    CHECK((received == length) && (number == 3));
+    CHECK(memcmp(block, data, length) == 0);
+
+    /* Corrupted data is rejected */
+    wire[10] ^= 0x01;
+    transfer_begin(sv[0], -1);
+    wire_write(wire, size);
+    CHECK(read_packet(block, &received, &number, crc, 1000) == PACKET_ERROR);
+
+    return 0;
+}
+
+static int check_zmodem_frame(bool crc32)
+{
+    unsigned char data[256], buffer[ZMODEM_SUBPACKET], header[4];
+    size_t size, length;
+
+    for (int i = 0; i < 256; i++)
+    {
+        data[i] = i;
+    }
+
+    transfer_begin(sv[0], -1);
+    zmodem_begin(true);
+    tx_crc32 = crc32;
+    zmodem_position(header, 0x12345678);
+    zmodem_put_binary_header(ZDATA, header);
+    zmodem_put_data(data, sizeof(data), ZCRCW);
+    CHECK(zmodem_flush() == 0);
+
+    /* Flow control characters only appear escaped, apart from trailing XON */
+    size = wire_read();
+    CHECK(wire[size - 1] == XON);
+    for (size_t i = 0; i < size - 1; i++)
+    {
+        CHECK((wire[i] & 0x7f) != XON);
+        CHECK((wire[i] & 0x7f) != XOFF);
+    }
+
+    transfer_begin(sv[0], -1);
+    wire_write(wire, size);
+    memset(header, 0, sizeof(header));
+    CHECK(zmodem_read_header(header, 1000) == ZDATA);
+    CHECK(rx_crc32 == crc32);
+    CHECK(zmodem_header_position(header) == 0x12345678);
+    CHECK(zmodem_read_data(buffer, sizeof(buffer), &length) == ZCRCW);
+    CHECK((length == sizeof(data)) && (memcmp(buffer, data, length) == 0));
+
+    /* Corrupted data is rejected */
+    wire[size / 2] ^= 0x01;
+    transfer_begin(sv[0], -1);
+    wire_write(wire, size);
+    if (zmodem_read_header(header, 1000) == ZDATA)
+    {
+        CHECK(zmodem_read_data(buffer, sizeof(buffer), &length) == ZMODEM_ERROR);
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    {
+        perror("socketpair");
+        return EXIT_FAILURE;
+    }
+
+    if ((check_crc() < 0) ||
+        (check_block(BLOCK_SIZE, false) < 0) ||
+        (check_block(BLOCK_SIZE, true) < 0) ||
+        (check_block(BLOCK_SIZE_1K, true) < 0) ||
+        (check_zmodem_frame(false) < 0) ||
+        (check_zmodem_frame(true) < 0))
+    {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}